@@ -0,0 +1,149 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "audio.h"
+
+#define AMPLITUDE 28000
+#define M_PI 3.14159265358979323846
+
+void chip8_audio_init(struct Chip8Audio *audio, int rate) {
+    for (int i = 0; i < AUDIO_TABLESIZ; i++) {
+        audio->table[i] = AMPLITUDE * sin(2.0 * M_PI * i / AUDIO_TABLESIZ);
+    }
+    audio->phase = 0;
+    audio->step = ((uint64_t)AUDIO_TONE << 32) / rate;
+    audio->frame = rate / FRAMERATE;
+    audio->left = 0;
+    audio->gate = false;
+    audio->level = 0;
+    atomic_init(&audio->head, 0);
+    atomic_init(&audio->tail, 0);
+}
+
+bool chip8_audio_frame(struct Chip8Audio *audio, const struct Chip8 *chip8) {
+    const uint32_t head = atomic_load_explicit(&audio->head, memory_order_relaxed);
+    const uint32_t tail = atomic_load_explicit(&audio->tail, memory_order_acquire);
+    if (head - tail == AUDIO_QUEUESIZ) {
+        return false;
+    }
+
+    audio->gates[head & (AUDIO_QUEUESIZ - 1)] = chip8->sounding;
+    atomic_store_explicit(&audio->head, head + 1, memory_order_release);
+    return true;
+}
+
+// starts playing the next queued frame, or the last one again if there is none
+static void chip8_audio_next(struct Chip8Audio *audio) {
+    uint32_t tail = atomic_load_explicit(&audio->tail, memory_order_relaxed);
+    const uint32_t head = atomic_load_explicit(&audio->head, memory_order_acquire);
+    // the emulation got ahead of the device, what's too far behind is never heard
+    if (head - tail > AUDIO_LAG) {
+        tail = head - AUDIO_LAG;
+    }
+    if (tail != head) {
+        audio->gate = audio->gates[tail & (AUDIO_QUEUESIZ - 1)];
+        atomic_store_explicit(&audio->tail, tail + 1, memory_order_release);
+    }
+    audio->left = audio->frame;
+}
+
+void chip8_audio_render(struct Chip8Audio *audio, int16_t *samples, int len) {
+    while (len > 0) {
+        if (!audio->left) {
+            chip8_audio_next(audio);
+        }
+        const int run = audio->left < len ? audio->left : len;
+        const int target = audio->gate ? AUDIO_RAMP : 0;
+        uint32_t phase = audio->phase;
+        int level = audio->level;
+
+        if (!level && !target) {
+            memset(samples, 0, run * sizeof(*samples));
+            phase += audio->step * (uint32_t)run;
+        } else {
+            for (int i = 0; i < run; i++) {
+                level += (level < target) - (level > target);
+                samples[i] = audio->table[phase >> (32 - AUDIO_TABLEBITS)] * level / AUDIO_RAMP;
+                phase += audio->step;
+            }
+        }
+
+        audio->phase = phase;
+        audio->level = level;
+        audio->left -= run;
+        samples += run;
+        len -= run;
+    }
+}
+
+#define WAV_HEADER 44
+
+// the RIFF header of a WAV of `samples` samples, every number in it little endian
+static void chip8_audio_wav_header(uint8_t *header, int rate, uint32_t samples) {
+    const uint32_t bytes = samples * sizeof(int16_t);
+    const uint32_t fields[] = { bytes + WAV_HEADER - 8, 16, rate, rate * sizeof(int16_t), bytes };
+    memcpy(header, "RIFF....WAVEfmt ....\x01\x00\x01\x00........\x02\x00\x10\x00" "data....", WAV_HEADER);
+    // the offsets of `fields`
+    const int offsets[] = { 4, 16, 24, 28, 40 };
+    for (int i = 0; i < 5; i++) {
+        for (int b = 0; b < 4; b++) {
+            header[offsets[i] + b] = fields[i] >> (8 * b);
+        }
+    }
+}
+
+void chip8_audio_file_open(struct Chip8AudioFile *out, const char *filename, int rate) {
+    const size_t len = strlen(filename);
+    out->wav = len >= 4 && strcmp(filename + len - 4, ".wav") == 0;
+    out->file = fopen(filename, "wb");
+    if (!out->file) {
+        fputs("Error: Could not create the audio file.", stderr);
+        exit(1);
+    }
+
+    chip8_audio_init(&out->audio, rate);
+    out->rate = rate;
+    out->samples = 0;
+    out->buffer = malloc(out->audio.frame * sizeof(int16_t));
+    if (!out->buffer) {
+        fputs("Error: Could not allocate the audio buffer.", stderr);
+        exit(1);
+    }
+
+    // as long as it can be, for when it's streamed and never comes back to fill the length in
+    uint8_t header[WAV_HEADER];
+    chip8_audio_wav_header(header, rate, (UINT32_MAX - WAV_HEADER) / sizeof(int16_t));
+    if (out->wav && fwrite(header, WAV_HEADER, 1, out->file) != 1) {
+        fputs("Error: Could not write the audio file.", stderr);
+        exit(1);
+    }
+}
+
+void chip8_audio_file_frame(struct Chip8AudioFile *out, const struct Chip8 *chip8) {
+    const int len = out->audio.frame;
+    chip8_audio_frame(&out->audio, chip8);
+    chip8_audio_render(&out->audio, out->buffer, len);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    for (int i = 0; i < len; i++) {
+        out->buffer[i] = __builtin_bswap16(out->buffer[i]);
+    }
+#endif
+    if (fwrite(out->buffer, sizeof(int16_t), len, out->file) != (size_t)len) {
+        fputs("Error: Could not write the audio file.", stderr);
+        exit(1);
+    }
+    out->samples += len;
+}
+
+void chip8_audio_file_close(struct Chip8AudioFile *out) {
+    if (out->wav && fseek(out->file, 0, SEEK_SET) == 0) {
+        uint8_t header[WAV_HEADER];
+        chip8_audio_wav_header(header, out->rate, out->samples);
+        fwrite(header, WAV_HEADER, 1, out->file);
+    }
+    if (fclose(out->file) != 0) {
+        fputs("Error: Could not write the audio file.", stderr);
+        exit(1);
+    }
+    free(out->buffer);
+}
@@ -0,0 +1,76 @@
+#ifndef CHIP8_AUDIO
+#define CHIP8_AUDIO
+#include <stdatomic.h>
+#include <stdio.h>
+#include "cpu.h"
+
+// samples a second, unless the device plays at another rate
+#define AUDIO_RATE 44100
+// pitch of the tone, in hz
+#define AUDIO_TONE 441
+// entries in the wavetable, as a power of 2
+#define AUDIO_TABLEBITS 8
+#define AUDIO_TABLESIZ (1 << AUDIO_TABLEBITS)
+// frames whose tone can be queued, a power of 2
+#define AUDIO_QUEUESIZ 64
+// frames queued beyond this many are skipped, so the tone never lags the screen by more
+#define AUDIO_LAG 3
+// samples the tone takes to fade in or out, so that it doesn't click when it starts or stops
+#define AUDIO_RAMP 64
+
+// Plays the tone for as long as the sound timer runs, a frame of samples at a time.
+// The emulation queues whether the tone sounds in each frame it runs and the audio
+// thread takes them one per frame's worth of samples, without locks. The tone comes
+// from a table looked up by a phase that keeps going across buffers, so it never jumps.
+struct Chip8Audio {
+    // a period of the tone
+    int16_t table[AUDIO_TABLESIZ];
+    // position in the period as a fraction of 2^32, and how far every sample moves it
+    uint32_t phase;
+    uint32_t step;
+    // samples in a frame
+    int frame;
+    // samples left of the frame being played, and whether the tone sounds in it
+    int left;
+    bool gate;
+    // how loud the tone is, from 0 to AUDIO_RAMP
+    int level;
+    // whether the tone sounds in each queued frame
+    bool gates[AUDIO_QUEUESIZ];
+    _Alignas(64) _Atomic(uint32_t) head;
+    _Alignas(64) _Atomic(uint32_t) tail;
+};
+
+// sets `audio` up for playing `rate` samples a second
+void chip8_audio_init(struct Chip8Audio *audio, int rate);
+
+// queues whether the tone sounds for the frame `chip8` just ran, which is played while the next one runs:
+// it does if the sound timer was still running at the end of it, so ST=n sounds for n frames.
+// called by the emulation once a frame, returns false if the queue is full
+bool chip8_audio_frame(struct Chip8Audio *audio, const struct Chip8 *chip8);
+
+// writes the next `len` samples, signed 16 bit, taking queued frames as it gets to them.
+// if none are queued it keeps playing (or not) the tone of the last one
+void chip8_audio_render(struct Chip8Audio *audio, int16_t *samples, int len);
+
+// Renders the tone to a file instead of a device, a frame of samples as soon as each frame was run,
+// so it's made as fast as the emulation goes rather than in real time. The file is a WAV if its name
+// ends in .wav and raw signed 16 bit little endian mono samples otherwise.
+struct Chip8AudioFile {
+    struct Chip8Audio audio;
+    FILE *file;
+    bool wav;
+    int rate;
+    // samples written so far
+    uint32_t samples;
+    // a frame of samples
+    int16_t *buffer;
+};
+
+// creates `filename` for `rate` samples a second, exits on errors
+void chip8_audio_file_open(struct Chip8AudioFile *out, const char *filename, int rate);
+// writes the samples of the frame `chip8` just ran, the same ones the device would play for it
+void chip8_audio_file_frame(struct Chip8AudioFile *out, const struct Chip8 *chip8);
+// finishes the file, filling in the length of a WAV if the file can be gone back in
+void chip8_audio_file_close(struct Chip8AudioFile *out);
+#endif
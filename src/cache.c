@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "cache.h"
+
+struct Chip8Cache *chip8_cache_new(void) {
+    struct Chip8Cache *cache = calloc(1, sizeof(struct Chip8Cache));
+    if (!cache) {
+        fputs("Error: Could not allocate the instruction cache.", stderr);
+        exit(1);
+    }
+
+    return cache;
+}
+
+void chip8_cache_free(struct Chip8Cache *cache) {
+    free(cache);
+}
+
+const struct Chip8Inst *chip8_cache_block(struct Chip8Cache *cache, const struct Chip8 *chip8, uint16_t pc, uint8_t *len) {
+    if (!cache->len[pc]) {
+        uint8_t n = 0;
+        uint16_t addr = pc;
+        // a block always holds at least one instruction, so that it can be run
+        while (n < BLOCKSIZ && addr < MEMORYSIZ - 1) {
+            const uint16_t opcode = (chip8->memory[addr] << 8) | chip8->memory[addr + 1];
+            cache->insts[addr] = chip8_decode(opcode);
+            cache->decoded[addr] = cache->decoded[addr + 1] = true;
+            ++n;
+
+            if (cache->insts[addr].flags & (CHIP8_INST_BRANCH | CHIP8_INST_WRITE | CHIP8_INST_DRAW)) {
+                break;
+            }
+            addr += 2;
+        }
+        cache->len[pc] = n;
+    }
+
+    *len = cache->len[pc];
+    return &cache->insts[pc];
+}
+
+bool chip8_cache_decoded(const struct Chip8Cache *cache, uint16_t addr, uint16_t size) {
+    for (int i = addr; i < addr + size && i < MEMORYSIZ; i++) {
+        if (cache->decoded[i]) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void chip8_cache_invalidate(struct Chip8Cache *cache, uint16_t addr, uint16_t size) {
+    // the earliest block that could still reach `addr`
+    const int first = addr > 2 * BLOCKSIZ ? addr - 2 * BLOCKSIZ : 0;
+    const int end = addr + size < MEMORYSIZ ? addr + size : MEMORYSIZ;
+
+    for (int start = first; start < end; start++) {
+        if (start + 2 * cache->len[start] > addr) {
+            cache->len[start] = 0;
+        }
+    }
+    // no block is left that was decoded from them
+    for (int i = addr; i < end; i++) {
+        cache->decoded[i] = false;
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef CHIP8_CACHE
+#define CHIP8_CACHE
+#include "cpu.h"
+
+// the most instructions translated into a single block
+#define BLOCKSIZ 32
+
+// Straight line runs of instructions, decoded once and then run as a whole.
+// A block starts at any address and ends at the first instruction that
+// branches, draws or writes to memory (or after BLOCKSIZ instructions).
+struct Chip8Cache {
+    // the instruction decoded at every address, only valid inside of a block
+    struct Chip8Inst insts[MEMORYSIZ];
+    // amount of instructions in the block starting at every address, 0 if it wasn't translated
+    uint8_t len[MEMORYSIZ];
+    // the bytes some block was decoded from since they were last written,
+    // a write to any other byte can't change a block (or its native code)
+    bool decoded[MEMORYSIZ];
+};
+
+struct Chip8Cache *chip8_cache_new(void);
+void chip8_cache_free(struct Chip8Cache *cache);
+
+// returns the block starting at `pc`, translating it first if needed.
+// the instructions of the block are 2 entries apart, its length is stored in `len`
+const struct Chip8Inst *chip8_cache_block(struct Chip8Cache *cache, const struct Chip8 *chip8, uint16_t pc, uint8_t *len);
+
+// whether a block may have been decoded from any of the `size` bytes starting at `addr`
+bool chip8_cache_decoded(const struct Chip8Cache *cache, uint16_t addr, uint16_t size);
+
+// drops every block that covers any of the `size` bytes starting at `addr`
+void chip8_cache_invalidate(struct Chip8Cache *cache, uint16_t addr, uint16_t size);
+#endif
@@ -0,0 +1,120 @@
+// needed for writev
+#define _DEFAULT_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "capture.h"
+
+#define Y4M_HEADER "YUV4MPEG2 W64 H32 F60:1 Ip A1:1 Cmono\n"
+#define Y4M_FRAME_HEADER "FRAME\n"
+
+static size_t capture_frame_size(enum Chip8CaptureFormat format) {
+    return format == CAPTURE_Y4M ? CAPTURE_Y4M_FRAME : CAPTURE_RAW_FRAME;
+}
+
+// writes all of `iov`, going on after short writes and interruptions
+static void capture_writev(int fd, struct iovec *iov, int count) {
+    while (count > 0) {
+        ssize_t written = writev(fd, iov, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fputs("Error: Could not write the captured frames.", stderr);
+            exit(1);
+        }
+        // skips what went through, the first vector left may have gone through in part
+        while (count > 0 && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (uint8_t *)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+}
+
+struct Chip8Capture *chip8_capture_new(int fd, enum Chip8CaptureFormat format, bool changes_only) {
+    struct Chip8Capture *capture = malloc(sizeof(struct Chip8Capture));
+    uint8_t *buffer = malloc(CAPTURE_BATCH * capture_frame_size(format));
+    if (!capture || !buffer) {
+        fputs("Error: Could not allocate the capture buffer.", stderr);
+        exit(1);
+    }
+
+    *capture = (struct Chip8Capture) {
+        .fd = fd,
+        .format = format,
+        .changes_only = changes_only,
+        .batched = 0,
+        .buffer = buffer,
+        .frames = 0,
+    };
+
+    if (format == CAPTURE_Y4M) {
+        struct iovec header = { .iov_base = Y4M_HEADER, .iov_len = strlen(Y4M_HEADER) };
+        capture_writev(fd, &header, 1);
+    }
+    return capture;
+}
+
+void chip8_capture_free(struct Chip8Capture *capture) {
+    if (!capture) {
+        return;
+    }
+    chip8_capture_flush(capture);
+    free(capture->buffer);
+    free(capture);
+}
+
+void chip8_capture_frame(struct Chip8Capture *capture, const struct Chip8 *chip8) {
+    if (capture->changes_only && capture->frames > 0 && memcmp(capture->last, chip8->video, sizeof(capture->last)) == 0) {
+        return;
+    }
+    memcpy(capture->last, chip8->video, sizeof(capture->last));
+
+    uint8_t *out = capture->buffer + capture->batched * capture_frame_size(capture->format);
+    for (int y = 0; y < VIDEO_H; y++) {
+        const uint64_t row = chip8->video[y];
+        if (capture->format == CAPTURE_Y4M) {
+            for (int x = 0; x < VIDEO_W; x++) {
+                *out++ = -(uint8_t)(row >> (VIDEO_W - 1 - x) & 1);
+            }
+        } else {
+            for (int b = 0; b < 8; b++) {
+                *out++ = row >> (56 - 8 * b);
+            }
+        }
+    }
+
+    capture->frames++;
+    if (++capture->batched == CAPTURE_BATCH) {
+        chip8_capture_flush(capture);
+    }
+}
+
+void chip8_capture_flush(struct Chip8Capture *capture) {
+    if (!capture->batched) {
+        return;
+    }
+
+    const size_t size = capture_frame_size(capture->format);
+    // every frame of a Y4M comes after a header of its own, which points at the same string every time
+    struct iovec iov[2 * CAPTURE_BATCH];
+    int count = 0;
+    if (capture->format == CAPTURE_Y4M) {
+        for (int i = 0; i < capture->batched; i++) {
+            iov[count++] = (struct iovec) { .iov_base = Y4M_FRAME_HEADER, .iov_len = strlen(Y4M_FRAME_HEADER) };
+            iov[count++] = (struct iovec) { .iov_base = capture->buffer + i * size, .iov_len = size };
+        }
+    } else {
+        iov[count++] = (struct iovec) { .iov_base = capture->buffer, .iov_len = capture->batched * size };
+    }
+    capture_writev(capture->fd, iov, count);
+    capture->batched = 0;
+}
@@ -0,0 +1,45 @@
+#ifndef CHIP8_CAPTURE
+#define CHIP8_CAPTURE
+#include "cpu.h"
+
+// frames gathered before they are written out all at once, with a single writev
+#define CAPTURE_BATCH 64
+// a frame as raw 1 bit pixels: every row left to right as 8 bytes, the leftmost pixel in the top bit
+#define CAPTURE_RAW_FRAME (VIDEO_W * VIDEO_H / 8)
+// a frame of a Y4M, its luma plane: a byte per pixel, 0 or 255
+#define CAPTURE_Y4M_FRAME (VIDEO_W * VIDEO_H)
+
+enum Chip8CaptureFormat {
+    // a monochrome YUV4MPEG2 video at 60 fps, which players and ffmpeg read as is
+    CAPTURE_Y4M,
+    // frames of CAPTURE_RAW_FRAME bytes back to back, with no header
+    CAPTURE_RAW,
+};
+
+// Streams the screen of every frame to a file or a pipe, with no window or SDL.
+// Frames are converted into a buffer allocated up front, room for CAPTURE_BATCH
+// of them, which is written out with one system call when it fills up.
+struct Chip8Capture {
+    int fd;
+    enum Chip8CaptureFormat format;
+    // frames whose screen is the same as the previous frame's are left out
+    bool changes_only;
+    // the screen of the last frame that was captured
+    uint64_t last[VIDEO_H];
+    // frames in `buffer`, waiting to be written
+    int batched;
+    uint8_t *buffer;
+    // frames captured so far, written out or not
+    long long frames;
+};
+
+// starts capturing to `fd`, which stays the caller's, and writes the header of the format
+struct Chip8Capture *chip8_capture_new(int fd, enum Chip8CaptureFormat format, bool changes_only);
+// writes out what is left and frees `capture`
+void chip8_capture_free(struct Chip8Capture *capture);
+
+// captures the screen of `chip8` at the end of a frame
+void chip8_capture_frame(struct Chip8Capture *capture, const struct Chip8 *chip8);
+// writes out the frames gathered so far
+void chip8_capture_flush(struct Chip8Capture *capture);
+#endif
@@ -1,9 +1,12 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <SDL2/SDL.h>
 #include "cpu.h"
 #include "opcode.h"
+#include "cache.h"
+#include "jit.h"
+#include "profile.h"
+#include "trace.h"
 
 
 const uint8_t chip8_font_set[FONTSETSIZ] = {
@@ -26,187 +29,349 @@ const uint8_t chip8_font_set[FONTSETSIZ] = {
 };
 
 struct Chip8 chip8_new(void) {
-    return (struct Chip8) {
+    struct Chip8 chip8 = {
         .memory = {0},
         .stack = {0},
         .registers = {0},
         .keypad = {0},
         .video = {0},
+        .dirty_rows = 0,
         .index = 0,
         .pc = INSTADDR,
         .sound_timer = 0,
         .delay_timer = 0,
         .sp = 0,
-        .inst = 0,
+        .halt = 0,
+        .rng = RNG_SEED,
+        .cache = NULL,
+        .jit = NULL,
+        .trace = NULL,
+        .sounding = false,
     };
+    chip8.video_hash = chip8_video_hash(chip8.video);
+    return chip8;
 } 
 
-void chip8_load_rom(struct Chip8 *chip8, const char *restrict filename) {
-    FILE *rom = fopen(filename, "r");
+const char *chip8_try_load_rom(struct Chip8 *chip8, const char *restrict filename) {
+    FILE *rom = fopen(filename, "rb");
     if (!rom) {
-        fputs("Error: Could not open ROM.", stderr);
-        exit(1);
+        return "Could not open ROM";
     }
 
     fseek(rom, 0, SEEK_END);
-    const int rom_size = ftell(rom);
+    const long rom_size = ftell(rom);
     fseek(rom, 0, SEEK_SET);
 
+    if (rom_size < 0) {
+        fclose(rom);
+        return "Could not read ROM";
+    }
     if (rom_size > MEMORYSIZ - INSTADDR) {
-        fputs("Error: ROM is bigger than the total memory size.", stderr);
+        fclose(rom);
+        return "ROM is bigger than the total memory size";
+    }
+
+    // an empty ROM reads nothing too, there's no program in it
+    const size_t read = fread(chip8->memory + INSTADDR, 1, rom_size, rom);
+    const bool failed = read == 0 || read != (size_t)rom_size || ferror(rom);
+    fclose(rom);
+    if (failed) {
+        return "Could not read ROM";
+    }
+    chip8_invalidate(chip8, INSTADDR, rom_size);
+    return NULL;
+}
+
+void chip8_load_rom(struct Chip8 *chip8, const char *restrict filename) {
+    const char *error = chip8_try_load_rom(chip8, filename);
+    if (error) {
+        fprintf(stderr, "Error: %s.", error);
         exit(1);
     }
+}
 
-    fread(chip8->memory + INSTADDR, MEMORYSIZ - INSTADDR, rom_size, rom);
+// SYS addr and anything else that isn't a known opcode is ignored
+static void chip8_op_ignore(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    (void)chip8;
+    (void)inst;
 }
 
-uint64_t end_time = 0;
-uint64_t start_500hz = 0;
-uint64_t start_60hz = 0;
+struct Chip8Op {
+    chip8_op exec;
+    uint8_t flags;
+};
+
+// second level tables, for the opcode groups that are told apart by their lower bits
+static const struct Chip8Op chip8_ops_0[0x100] = {
+    [0xE0] = { chip8_op_00e0, CHIP8_INST_DRAW },
+    [0xEE] = { chip8_op_00ee, CHIP8_INST_BRANCH },
+};
+
+static const struct Chip8Op chip8_ops_8[0x10] = {
+    [0x0] = { chip8_op_8xy0, CHIP8_INST_VX },
+    [0x1] = { chip8_op_8xy1, CHIP8_INST_VX },
+    [0x2] = { chip8_op_8xy2, CHIP8_INST_VX },
+    [0x3] = { chip8_op_8xy3, CHIP8_INST_VX },
+    [0x4] = { chip8_op_8xy4, CHIP8_INST_VX | CHIP8_INST_VF },
+    [0x5] = { chip8_op_8xy5, CHIP8_INST_VX | CHIP8_INST_VF },
+    [0x6] = { chip8_op_8xy6, CHIP8_INST_VX | CHIP8_INST_VF },
+    [0x7] = { chip8_op_8xy7, CHIP8_INST_VX | CHIP8_INST_VF },
+    [0xE] = { chip8_op_8xye, CHIP8_INST_VX | CHIP8_INST_VF },
+};
+
+static const struct Chip8Op chip8_ops_e[0x100] = {
+    [0x9E] = { chip8_op_ex9e, CHIP8_INST_BRANCH },
+    [0xA1] = { chip8_op_exa1, CHIP8_INST_BRANCH },
+};
+
+static const struct Chip8Op chip8_ops_f[0x100] = {
+    [0x07] = { chip8_op_fx07, CHIP8_INST_VX },
+    [0x0A] = { chip8_op_fx0a, CHIP8_INST_BRANCH | CHIP8_INST_VX },
+    [0x15] = { chip8_op_fx15, CHIP8_INST_TIMERS },
+    [0x18] = { chip8_op_fx18, CHIP8_INST_TIMERS },
+    [0x1E] = { chip8_op_fx1e, CHIP8_INST_INDEX },
+    [0x29] = { chip8_op_fx29, CHIP8_INST_INDEX },
+    [0x33] = { chip8_op_fx33, CHIP8_INST_WRITE },
+    [0x55] = { chip8_op_fx55, CHIP8_INST_WRITE },
+    [0x65] = { chip8_op_fx65, CHIP8_INST_VREGS },
+};
+
+// first level table, indexed by the highest nibble of the opcode.
+// groups with a single instruction point straight to their handler,
+// the others are looked up again in `ops` using the bits in `mask`
+static const struct {
+    struct Chip8Op op;
+    const struct Chip8Op *ops;
+    uint16_t mask;
+} chip8_op_groups[0x10] = {
+    [0x0] = { .ops = chip8_ops_0, .mask = 0x00FF },
+    [0x1] = { .op = { chip8_op_1nnn, CHIP8_INST_BRANCH } },
+    [0x2] = { .op = { chip8_op_2nnn, CHIP8_INST_BRANCH } },
+    [0x3] = { .op = { chip8_op_3xkk, CHIP8_INST_BRANCH } },
+    [0x4] = { .op = { chip8_op_4xkk, CHIP8_INST_BRANCH } },
+    [0x5] = { .op = { chip8_op_5xy0, CHIP8_INST_BRANCH } },
+    [0x6] = { .op = { chip8_op_6xkk, CHIP8_INST_VX } },
+    [0x7] = { .op = { chip8_op_7xkk, CHIP8_INST_VX } },
+    [0x8] = { .ops = chip8_ops_8, .mask = 0x000F },
+    [0x9] = { .op = { chip8_op_9xy0, CHIP8_INST_BRANCH } },
+    [0xA] = { .op = { chip8_op_annn, CHIP8_INST_INDEX } },
+    [0xB] = { .op = { chip8_op_bnnn, CHIP8_INST_BRANCH } },
+    [0xC] = { .op = { chip8_op_cxkk, CHIP8_INST_VX } },
+    [0xD] = { .op = { chip8_op_dxyn, CHIP8_INST_DRAW | CHIP8_INST_VF } },
+    [0xE] = { .ops = chip8_ops_e, .mask = 0x00FF },
+    [0xF] = { .ops = chip8_ops_f, .mask = 0x00FF },
+};
+
+struct Chip8Inst chip8_decode(uint16_t opcode) {
+    static const struct Chip8Op ignore = { chip8_op_ignore, 0 };
+    const uint8_t group = opcode >> 12;
+    const struct Chip8Op *op = &chip8_op_groups[group].op;
+    // CLS and RET are the only 0nnn opcodes with x = 0, the rest are SYS addr
+    if (chip8_op_groups[group].ops && !(group == 0x0 && (opcode & 0x0F00))) {
+        op = &chip8_op_groups[group].ops[opcode & chip8_op_groups[group].mask];
+    }
+    if (!op->exec) {
+        op = &ignore;
+    }
+
+    return (struct Chip8Inst) {
+        .exec = op->exec,
+        .flags = op->flags,
+        .nnn = opcode & 0x0FFF,
+        .x = (opcode & 0x0F00) >> 8,
+        .y = (opcode & 0x00F0) >> 4,
+        .n = opcode & 0x000F,
+        .kk = opcode & 0x00FF,
+    };
+}
+
+void chip8_invalidate(struct Chip8 *chip8, uint16_t addr, uint16_t size) {
+    addr = MEMORY_ADDR(addr);
+    // writes that ran past the end of memory wrapped around to its start
+    if (addr + size > MEMORYSIZ) {
+        chip8_invalidate(chip8, 0, addr + size - MEMORYSIZ);
+        size = MEMORYSIZ - addr;
+    }
+
+    // most writes are to data, and native code is only ever translated from decoded blocks
+    if (!chip8->cache || !chip8_cache_decoded(chip8->cache, addr, size)) {
+        return;
+    }
+
+    // the native code is dropped first, it needs the lengths of the blocks that are still cached
+    if (chip8->jit) {
+        chip8_jit_invalidate(chip8->jit, addr, size);
+    }
+    chip8_cache_invalidate(chip8->cache, addr, size);
+}
 
 void chip8_cycle(struct Chip8 *chip8) {
-    float delta_inst = (end_time - start_500hz) / (float)SDL_GetPerformanceFrequency() * 1000.0;
-    float delta_timer = (end_time - start_60hz) / (float)SDL_GetPerformanceFrequency() * 1000.0;
-
-    // timers are run at 60hz
-    if (delta_timer > 1000/60.0) {
-        start_60hz = end_time;
-        if (chip8->sound_timer > 0) {
-            --chip8->sound_timer;
+    const uint16_t pc = MEMORY_ADDR(chip8->pc);
+    const uint16_t opcode = (chip8->memory[pc] << 8) | chip8->memory[MEMORY_ADDR(pc + 1)];
+    chip8->pc = pc + 2;
+
+    const struct Chip8Inst inst = chip8_decode(opcode);
+    CHIP8_PROFILE_EXEC(chip8, &inst);
+    if (chip8->trace) {
+        chip8_trace_exec(chip8->trace, chip8, pc, opcode);
+    }
+}
+
+int chip8_idle_loop(const struct Chip8 *chip8, uint16_t pc) {
+    // most blocks start with something else altogether
+    const uint8_t group = chip8->memory[pc] >> 4;
+    if (group != 0x1 && group != 0xE && group != 0xF) {
+        return 0;
+    }
+
+    uint16_t ops[3];
+    for (int i = 0; i < 3; i++) {
+        ops[i] = chip8->memory[MEMORY_ADDR(pc + 2 * i)] << 8 | chip8->memory[MEMORY_ADDR(pc + 2 * i + 1)];
+    }
+    const uint16_t jump_back = 0x1000 | pc;
+    const uint8_t x = (ops[0] & 0x0F00) >> 8;
+
+    if (ops[0] == jump_back) {
+        return 1;
+    }
+    if (((ops[0] & 0xF0FF) == 0xE09E || (ops[0] & 0xF0FF) == 0xE0A1) && ops[1] == jump_back) {
+        return 2;
+    }
+    if ((ops[0] & 0xF0FF) == 0xF007 && ((ops[1] & 0xFF00) == (0x3000 | x << 8) || (ops[1] & 0xFF00) == (0x4000 | x << 8))
+        && ops[2] == jump_back) {
+        return 3;
+    }
+
+    return 0;
+}
+
+// Returns the instructions that whole rounds of the idle loop at PC take out of `budget`, having
+// left the machine as running them would have, or 0 if PC isn't at one or it's about to be left.
+static int chip8_idle(struct Chip8 *chip8, int budget) {
+    const uint16_t pc = chip8->pc;
+    const int len = chip8_idle_loop(chip8, pc);
+    if (!len) {
+        return 0;
+    }
+
+    const uint8_t x = chip8->memory[pc] & 0x0F;
+    if (len == 2) {
+        // the jump is only skipped once the key is down (Ex9E) or up (ExA1)
+        const bool pressed = chip8->keypad[chip8->registers[x] % KEYPADSIZ];
+        if (pressed == (chip8->memory[MEMORY_ADDR(pc + 1)] == 0x9E)) {
+            return 0;
         }
+    } else if (len == 3) {
+        // the jump is only skipped once the timer is kk (3xkk) or isn't kk anymore (4xkk)
+        const bool equal = chip8->delay_timer == chip8->memory[MEMORY_ADDR(pc + 3)];
+        if (equal == (chip8->memory[MEMORY_ADDR(pc + 2)] >> 4 == 0x3)) {
+            return 0;
+        }
+        chip8->registers[x] = chip8->delay_timer;
+    }
 
-        if (chip8->delay_timer > 0) {
-            --chip8->delay_timer;
+    // the last partial round is run as usual
+    return budget / len * len;
+}
+
+int chip8_run_block(struct Chip8 *chip8, int budget) {
+    chip8->pc = MEMORY_ADDR(chip8->pc);
+    // every instruction is counted while profiling or tracing, idle ones included
+    const int idle = CHIP8_PROFILING(chip8) || chip8->trace ? 0 : chip8_idle(chip8, budget);
+    if (idle) {
+        return idle;
+    }
+
+    if (!chip8->cache || chip8->pc >= MEMORYSIZ - 1) {
+        chip8_cycle(chip8);
+        return 1;
+    }
+
+    uint8_t len;
+    const struct Chip8Inst *block = chip8_cache_block(chip8->cache, chip8, chip8->pc, &len);
+    if (chip8->jit && len <= budget && !CHIP8_PROFILING(chip8) && !chip8->trace) {
+        const int done = chip8_jit_run(chip8->jit, chip8, block, len, budget);
+        if (done) {
+            return done;
         }
     }
 
-    // the instructions are run at 500hz
-    if (delta_inst > 1000/500.0) {
-        start_500hz = end_time;
-        chip8->inst = (chip8->memory[chip8->pc] << 8) | chip8->memory[chip8->pc + 1];
+    if (len > budget) {
+        len = budget;
+    }
+    // a traced machine records every instruction as it's run, with the opcode it was decoded from
+    if (chip8->trace) {
+        chip8_trace_block(chip8->trace, chip8, block, len);
+        return len;
+    }
+    for (uint8_t i = 0; i < len; i++) {
+        const struct Chip8Inst *inst = &block[2 * i];
         chip8->pc += 2;
+        CHIP8_PROFILE_EXEC(chip8, inst);
+    }
 
-        // parses and runs instructions
-        switch (chip8->inst & 0xF000) {
-            case 0x0000:
-                switch (chip8->inst) {
-                    case 0x00E0:
-                        chip8_op_00e0(chip8);
-                    break;
-                    case 0x00EE:
-                        chip8_op_00ee(chip8);
-                    break;
-                }
-            break;
-            case 0x1000:
-                chip8_op_1nnn(chip8);
-            break;
-            case 0x2000:
-                chip8_op_2nnn(chip8);
-            break;
-            case 0x3000:
-                chip8_op_3xkk(chip8);
-            break;
-            case 0x4000:
-                chip8_op_4xkk(chip8);
-            break;
-            case 0x5000:
-                chip8_op_5xy0(chip8);
-            break;
-            case 0x6000:
-                chip8_op_6xkk(chip8);
-            break;
-            case 0x7000:
-                chip8_op_7xkk(chip8);
-            break;
-            case 0x8000:
-                switch (chip8->inst & 0x000F) {
-                    case 0x0000:
-                        chip8_op_8xy0(chip8);
-                    break;
-                    case 0x0001:
-                        chip8_op_8xy1(chip8);
-                    break;
-                    case 0x0002:
-                        chip8_op_8xy2(chip8);
-                    break;
-                    case 0x0003:
-                        chip8_op_8xy3(chip8);
-                    break;
-                    case 0x0004:
-                        chip8_op_8xy4(chip8);
-                    break;
-                    case 0x0005:
-                        chip8_op_8xy5(chip8);
-                    break;
-                    case 0x0006:
-                        chip8_op_8xy6(chip8);
-                    break;
-                    case 0x0007:
-                        chip8_op_8xy7(chip8);
-                    break;
-                    case 0x000E:
-                        chip8_op_8xye(chip8);
-                    break;
-                }
-            break;
-            case 0x9000:
-                chip8_op_9xy0(chip8);
-            break;
-            case 0xA000:
-                chip8_op_annn(chip8);
-            break;
-            case 0xB000:
-                chip8_op_bnnn(chip8);
-            break;
-            case 0xC000:
-                chip8_op_cxkk(chip8);
-            break;
-            case 0xD000:
-                chip8_op_dxyn(chip8);
-            break;
-            case 0xE000:
-                switch (chip8->inst & 0x00FF) {
-                    case 0x00A1:
-                        chip8_op_exa1(chip8);
-                    break;
-                    case 0x009E:
-                        chip8_op_ex9e(chip8);
-                    break;
-                }
-            break;
-            case 0xF000:
-                switch (chip8->inst & 0x00FF) {
-                    case 0x0007:
-                        chip8_op_fx07(chip8);
-                    break;
-                    case 0x000A:
-                        chip8_op_fx0a(chip8);
-                    break;
-                    case 0x0015:
-                        chip8_op_fx15(chip8);
-                    break;
-                    case 0x0018:
-                        chip8_op_fx18(chip8);
-                    break;
-                    case 0x001E:
-                        chip8_op_fx1e(chip8);
-                    break;
-                    case 0x0029:
-                        chip8_op_fx29(chip8);
-                    break;
-                    case 0x0033:
-                        chip8_op_fx33(chip8);
-                    break;
-                    case 0x0055:
-                        chip8_op_fx55(chip8);
-                    break;
-                    case 0x0065:
-                        chip8_op_fx65(chip8);
-                    break;
-                }
-            break;
-        }
+    return len;
+}
+
+int chip8_run(struct Chip8 *chip8, int budget) {
+    int done = 0;
+    // a halted CPU runs nothing until the key Fx0A waits for comes back up, the timers still tick
+    while (done < budget && !CHIP8_HALTED(chip8)) {
+        done += chip8_run_block(chip8, budget - done);
+    }
+
+    return done;
+}
+
+void chip8_key(struct Chip8 *chip8, uint8_t key, bool down) {
+    key %= KEYPADSIZ;
+    chip8->keypad[key] = down;
+
+    if (down && chip8->halt == CHIP8_HALT_PRESS) {
+        chip8->halt = CHIP8_HALT_RELEASE | key;
+    } else if (!down && chip8->halt == (CHIP8_HALT_RELEASE | key)) {
+        chip8->halt = CHIP8_HALT_DONE | key;
+    }
+}
+
+void chip8_tick_timers(struct Chip8 *chip8) {
+    chip8->sounding = chip8->sound_timer > 0;
+    if (chip8->sound_timer > 0) {
+        --chip8->sound_timer;
     }
-    end_time = SDL_GetPerformanceCounter();
+
+    if (chip8->delay_timer > 0) {
+        --chip8->delay_timer;
+    }
+}
+
+uint8_t chip8_random_next(uint32_t *rng) {
+    uint32_t x = *rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *rng = x;
+    // the high bits are the better mixed ones
+    return x >> 24;
+}
+
+uint8_t chip8_random(struct Chip8 *chip8) {
+    return chip8_random_next(&chip8->rng);
+}
+
+void chip8_seed(struct Chip8 *chip8, uint64_t seed) {
+    // a step of splitmix64, so that neighbouring seeds still start far apart
+    uint64_t z = seed + 0x9E3779B97F4A7C15;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+    z ^= z >> 31;
+    // xorshift never leaves 0
+    chip8->rng = (uint32_t)z ? (uint32_t)z : RNG_SEED;
+}
+
+int chip8_run_frame(struct Chip8 *chip8, int ipf) {
+    const int done = chip8_run(chip8, ipf);
+    chip8_tick_timers(chip8);
+    CHIP8_PROFILE_FRAME(chip8);
+    return done;
 }
@@ -28,32 +28,137 @@ enum Register {
 #define INSTADDR 0x200
 
 #define MEMORYSIZ 4096
+// addresses wrap around the end of memory instead of running past it
+#define MEMORY_ADDR(addr) ((addr) & (MEMORYSIZ - 1))
 #define STACKSIZ 16
 #define REGISTERSIZ 16
 #define KEYPADSIZ 16
 #define VIDEO_W 64
 #define VIDEO_H 32
 #define FONTSETSIZ 80
+// whether the pixel at (x, y) of a packed framebuffer is lit
+#define VIDEO_PIXEL(video, x, y) (((video)[(y)] >> (VIDEO_W - 1 - (x))) & 1)
+// the timers tick at 60hz, a frame is the emulated time between two ticks
+#define FRAMERATE 60
+// instructions run per frame by default, close to the usual 500hz
+#define IPF 8
+// the random number generator of a new machine starts from here
+#define RNG_SEED 0x2545F491
+
+// what a CPU halted by Fx0A is waiting for (in `halt`): a key to go down, and then that key to come back up
+#define CHIP8_HALT_PRESS 0x10
+#define CHIP8_HALT_RELEASE 0x20
+// the key came back up, Fx0A stores it and the CPU goes on
+#define CHIP8_HALT_DONE 0x30
+#define CHIP8_HALT_KEY 0x0F
+#define CHIP8_HALTED(chip8) ((chip8)->halt && ((chip8)->halt & ~CHIP8_HALT_KEY) != CHIP8_HALT_DONE)
 
 struct Chip8 {
     uint8_t memory[MEMORYSIZ];
     uint16_t stack[STACKSIZ];
     uint8_t registers[REGISTERSIZ];
     uint8_t keypad[KEYPADSIZ];
-    uint32_t video[VIDEO_W * VIDEO_H];
+    // one bit per pixel, a row per word, with x = 0 in the most significant bit
+    uint64_t video[VIDEO_H];
+    // a bit for every row of `video` that changed since whoever shows it last looked,
+    // so a frame with no bits set can be skipped altogether
+    uint32_t dirty_rows;
     uint16_t index;
     uint16_t pc;
     uint8_t sound_timer;
     uint8_t delay_timer;
     uint8_t sp;
-    // current instruction
-    uint16_t inst; 
+    // 0 while the CPU runs, otherwise what Fx0A waits for, with the key in the low bits
+    uint8_t halt;
+    // state of the xorshift generator behind RND, never 0, so every instance draws
+    // its own numbers and a run doesn't depend on whatever else the process is running
+    uint32_t rng;
+    // decoded blocks of this program, NULL to decode every instruction as it runs
+    struct Chip8Cache *cache;
+    // native code of the hottest blocks, NULL to only interpret them (needs `cache`)
+    struct Chip8Jit *jit;
+    // every instruction run is recorded into it, NULL to not record them (see trace.h)
+    struct Chip8Trace *trace;
+    // chip8_video_hash of `video`, kept up to date by the instructions that draw rather than saved
+    uint64_t video_hash;
+    // whether the tone sounds for the frame run last: the sound timer was still running when it ticked
+    // at the end of it, as ticking may have just stopped it
+    bool sounding;
+#ifdef CHIP8_PROFILER
+    // counts of what this machine runs, NULL to not count them (see profile.h)
+    struct Chip8Profile *profile;
+#endif
+};
+
+struct Chip8Inst;
+
+// runs a single decoded instruction
+typedef void (*chip8_op)(struct Chip8 *chip8, const struct Chip8Inst *inst);
+
+// the instruction may move the PC somewhere other than the next instruction, or stall the CPU
+#define CHIP8_INST_BRANCH 0x1
+// the instruction writes to memory
+#define CHIP8_INST_WRITE 0x2
+// the instruction draws to the screen
+#define CHIP8_INST_DRAW 0x4
+// the registers the instruction may write: Vx, VF, and every one from V0 to Vx
+#define CHIP8_INST_VX 0x8
+#define CHIP8_INST_VF 0x10
+#define CHIP8_INST_VREGS 0x20
+// the instruction may write I
+#define CHIP8_INST_INDEX 0x40
+// the instruction may set the delay or sound timer
+#define CHIP8_INST_TIMERS 0x80
+
+// an instruction decoded once into its handler and operands,
+// so that handlers never have to pick apart the raw opcode
+struct Chip8Inst {
+    chip8_op exec;
+    uint16_t nnn;
+    uint8_t x;
+    uint8_t y;
+    uint8_t n;
+    uint8_t kk;
+    uint8_t flags;
 };
 
 extern const uint8_t chip8_font_set[FONTSETSIZ];
 
 struct Chip8 chip8_new(void);
 void chip8_load_rom(struct Chip8 *chip8, const char *restrict filename);
+// the same, but returns what went wrong instead of exiting, NULL if the ROM was loaded
+const char *chip8_try_load_rom(struct Chip8 *chip8, const char *restrict filename);
+struct Chip8Inst chip8_decode(uint16_t opcode);
+// fetches, decodes and runs the instruction at PC, without going through the cache
 void chip8_cycle(struct Chip8 *chip8);
+// runs up to `budget` instructions, returns how many were run (fewer only if Fx0A halted the CPU)
+int chip8_run(struct Chip8 *chip8, int budget);
+// like chip8_run, but stops at the end of the current block (or, running native code,
+// of the blocks it goes straight on to)
+int chip8_run_block(struct Chip8 *chip8, int budget);
+// A loop that can't be left before the next timer tick or key change: a jump to itself,
+// polling the delay timer (Fx07, then 3xkk or 4xkk on that register, then a jump back)
+// or polling a key (Ex9E or ExA1, then a jump back). Neither the timers nor the keys
+// change within a frame, so the rest of the budget would only go around it again and again,
+// chip8_run_block goes around it all at once instead.
+// Returns the amount of instructions in the loop starting at `pc`, 0 if there's none.
+int chip8_idle_loop(const struct Chip8 *chip8, uint16_t pc);
+// must be called whenever memory is written, so stale decoded instructions are dropped
+void chip8_invalidate(struct Chip8 *chip8, uint16_t addr, uint16_t size);
+void chip8_tick_timers(struct Chip8 *chip8);
+// presses or releases a key, waking the CPU up if Fx0A was waiting for it.
+// the keypad should be changed through here, so that no press or release is missed
+void chip8_key(struct Chip8 *chip8, uint8_t key, bool down);
+// the next random byte of this machine
+uint8_t chip8_random(struct Chip8 *chip8);
+// the same, for a generator state kept anywhere else
+uint8_t chip8_random_next(uint32_t *rng);
+// starts the random numbers over from `seed`, the same seed always draws the same numbers
+void chip8_seed(struct Chip8 *chip8, uint64_t seed);
+// runs a frame worth of emulated time: `ipf` instructions and then a timer tick
+int chip8_run_frame(struct Chip8 *chip8, int ipf);
+// hashes a screen: the XOR of a hash of every row mixed with where the row is,
+// so drawing over rows only takes their old hashes out and puts their new ones in
+uint64_t chip8_video_hash(const uint64_t *video);
 
 #endif
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include "disasm.h"
+
+// what an instruction's operands are, in the order its format takes them
+enum DisasmArgs {
+    ARGS_NONE,
+    ARGS_NNN,
+    ARGS_X,
+    ARGS_X_KK,
+    ARGS_X_Y,
+    ARGS_X_Y_N,
+};
+
+struct DisasmInst {
+    uint16_t mask;
+    uint16_t match;
+    const char *name;
+    const char *format;
+    enum DisasmArgs args;
+};
+
+// 0nnn (SYS addr) goes last, it matches whatever 00E0 and 00EE don't
+static const struct DisasmInst disasm_insts[] = {
+    { 0xFFFF, 0x00E0, "00e0", "CLS", ARGS_NONE },
+    { 0xFFFF, 0x00EE, "00ee", "RET", ARGS_NONE },
+    { 0xF000, 0x1000, "1nnn", "JP 0x%03X", ARGS_NNN },
+    { 0xF000, 0x2000, "2nnn", "CALL 0x%03X", ARGS_NNN },
+    { 0xF000, 0x3000, "3xkk", "SE V%X, 0x%02X", ARGS_X_KK },
+    { 0xF000, 0x4000, "4xkk", "SNE V%X, 0x%02X", ARGS_X_KK },
+    { 0xF00F, 0x5000, "5xy0", "SE V%X, V%X", ARGS_X_Y },
+    { 0xF000, 0x6000, "6xkk", "LD V%X, 0x%02X", ARGS_X_KK },
+    { 0xF000, 0x7000, "7xkk", "ADD V%X, 0x%02X", ARGS_X_KK },
+    { 0xF00F, 0x8000, "8xy0", "LD V%X, V%X", ARGS_X_Y },
+    { 0xF00F, 0x8001, "8xy1", "OR V%X, V%X", ARGS_X_Y },
+    { 0xF00F, 0x8002, "8xy2", "AND V%X, V%X", ARGS_X_Y },
+    { 0xF00F, 0x8003, "8xy3", "XOR V%X, V%X", ARGS_X_Y },
+    { 0xF00F, 0x8004, "8xy4", "ADD V%X, V%X", ARGS_X_Y },
+    { 0xF00F, 0x8005, "8xy5", "SUB V%X, V%X", ARGS_X_Y },
+    { 0xF00F, 0x8006, "8xy6", "SHR V%X, V%X", ARGS_X_Y },
+    { 0xF00F, 0x8007, "8xy7", "SUBN V%X, V%X", ARGS_X_Y },
+    { 0xF00F, 0x800E, "8xye", "SHL V%X, V%X", ARGS_X_Y },
+    { 0xF00F, 0x9000, "9xy0", "SNE V%X, V%X", ARGS_X_Y },
+    { 0xF000, 0xA000, "annn", "LD I, 0x%03X", ARGS_NNN },
+    { 0xF000, 0xB000, "bnnn", "JP V0, 0x%03X", ARGS_NNN },
+    { 0xF000, 0xC000, "cxkk", "RND V%X, 0x%02X", ARGS_X_KK },
+    { 0xF000, 0xD000, "dxyn", "DRW V%X, V%X, %d", ARGS_X_Y_N },
+    { 0xF0FF, 0xE09E, "ex9e", "SKP V%X", ARGS_X },
+    { 0xF0FF, 0xE0A1, "exa1", "SKNP V%X", ARGS_X },
+    { 0xF0FF, 0xF007, "fx07", "LD V%X, DT", ARGS_X },
+    { 0xF0FF, 0xF00A, "fx0a", "LD V%X, K", ARGS_X },
+    { 0xF0FF, 0xF015, "fx15", "LD DT, V%X", ARGS_X },
+    { 0xF0FF, 0xF018, "fx18", "LD ST, V%X", ARGS_X },
+    { 0xF0FF, 0xF01E, "fx1e", "ADD I, V%X", ARGS_X },
+    { 0xF0FF, 0xF029, "fx29", "LD F, V%X", ARGS_X },
+    { 0xF0FF, 0xF033, "fx33", "LD B, V%X", ARGS_X },
+    { 0xF0FF, 0xF055, "fx55", "LD [I], V%X", ARGS_X },
+    { 0xF0FF, 0xF065, "fx65", "LD V%X, [I]", ARGS_X },
+    { 0xF000, 0x0000, "0nnn", "SYS 0x%03X", ARGS_NNN },
+};
+
+static const struct DisasmInst *disasm_find(uint16_t opcode) {
+    for (size_t i = 0; i < sizeof(disasm_insts) / sizeof(disasm_insts[0]); i++) {
+        if ((opcode & disasm_insts[i].mask) == disasm_insts[i].match) {
+            return &disasm_insts[i];
+        }
+    }
+    return NULL;
+}
+
+const char *chip8_opcode_name(uint16_t opcode) {
+    const struct DisasmInst *inst = disasm_find(opcode);
+    return inst ? inst->name : "data";
+}
+
+void chip8_disassemble(uint16_t opcode, char *out, size_t size) {
+    const struct DisasmInst *inst = disasm_find(opcode);
+    if (!inst) {
+        snprintf(out, size, "DW 0x%04X", opcode);
+        return;
+    }
+
+    const unsigned x = (opcode & 0x0F00) >> 8;
+    const unsigned y = (opcode & 0x00F0) >> 4;
+    switch (inst->args) {
+        case ARGS_NONE:
+            snprintf(out, size, "%s", inst->format);
+        break;
+
+        case ARGS_NNN:
+            snprintf(out, size, inst->format, opcode & 0x0FFF);
+        break;
+
+        case ARGS_X:
+            snprintf(out, size, inst->format, x);
+        break;
+
+        case ARGS_X_KK:
+            snprintf(out, size, inst->format, x, opcode & 0x00FF);
+        break;
+
+        case ARGS_X_Y:
+            snprintf(out, size, inst->format, x, y);
+        break;
+
+        case ARGS_X_Y_N:
+            snprintf(out, size, inst->format, x, y, opcode & 0x000F);
+        break;
+    }
+}
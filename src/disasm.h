@@ -0,0 +1,12 @@
+#ifndef CHIP8_DISASM
+#define CHIP8_DISASM
+#include <stddef.h>
+#include "cpu.h"
+
+// the instruction `opcode` is, named after its pattern like the handlers in opcode.h ("8xy4"),
+// "data" if it isn't one
+const char *chip8_opcode_name(uint16_t opcode);
+
+// writes `opcode` to `out` in assembly, e.g. "ADD V1, V2"
+void chip8_disassemble(uint16_t opcode, char *out, size_t size);
+#endif
@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "env.h"
+
+struct Chip8Env *chip8_env_new(const char *restrict filename, int count) {
+    struct Chip8Env *env = malloc(sizeof(struct Chip8Env));
+    if (!env) {
+        fputs("Error: Could not allocate the environment.", stderr);
+        exit(1);
+    }
+
+    env->lanes = chip8_lanes_new(count);
+    chip8_lanes_load_rom(env->lanes, filename);
+    env->start = *chip8_lanes_get(env->lanes, 0);
+    env->ipf = IPF;
+    env->max_pool = false;
+    return env;
+}
+
+void chip8_env_free(struct Chip8Env *env) {
+    if (!env) {
+        return;
+    }
+    chip8_lanes_free(env->lanes);
+    free(env);
+}
+
+static void env_observe(const struct Chip8Env *env, int machine, uint64_t *observation) {
+    memcpy(observation, env->lanes->machines[machine].video, CHIP8_ENV_OBS_WORDS * sizeof(uint64_t));
+}
+
+static void env_restart(struct Chip8Env *env, int machine, uint64_t seed) {
+    struct Chip8 chip8 = env->start;
+    // every machine gets a seed of its own
+    chip8_seed(&chip8, seed + machine * 0x9E3779B97F4A7C15);
+    chip8_lanes_set(env->lanes, machine, &chip8);
+}
+
+void chip8_env_reset(struct Chip8Env *env, uint64_t seed, uint64_t *observations) {
+    for (int i = 0; i < env->lanes->count; i++) {
+        env_restart(env, i, seed);
+    }
+    // all the memories are the ROM again
+    memset(env->lanes->written, 0, sizeof(env->lanes->written));
+
+    if (observations) {
+        for (int i = 0; i < env->lanes->count; i++) {
+            env_observe(env, i, &observations[i * CHIP8_ENV_OBS_WORDS]);
+        }
+    }
+}
+
+void chip8_env_reset_one(struct Chip8Env *env, int machine, uint64_t seed, uint64_t *observation) {
+    env_restart(env, machine, seed);
+    if (observation) {
+        env_observe(env, machine, observation);
+    }
+}
+
+long chip8_env_step(struct Chip8Env *env, const uint16_t *actions, int frames, uint64_t *observations) {
+    // with no frames run there would be no screen to observe
+    if (frames < 1) {
+        fputs("Error: A step has to run at least one frame.", stderr);
+        exit(1);
+    }
+
+    struct Chip8Lanes *lanes = env->lanes;
+    for (int i = 0; i < lanes->count; i++) {
+        const uint16_t keys = actions ? actions[i] : 0;
+        struct Chip8 *machine = &lanes->machines[i];
+        for (int k = 0; k < KEYPADSIZ; k++) {
+            if (machine->keypad[k] != (keys >> k & 1)) {
+                chip8_key(machine, k, keys >> k & 1);
+            }
+        }
+    }
+
+    long done = 0;
+    for (int frame = 0; frame < frames; frame++) {
+        done += chip8_lanes_run_frame(lanes, env->ipf);
+
+        // with max pooling every frame is observed, otherwise only the last
+        if (!observations || (!env->max_pool && frame + 1 < frames)) {
+            continue;
+        }
+        for (int i = 0; i < lanes->count; i++) {
+            uint64_t *observation = &observations[i * CHIP8_ENV_OBS_WORDS];
+            if (!env->max_pool || frame == 0) {
+                env_observe(env, i, observation);
+                continue;
+            }
+            for (int y = 0; y < CHIP8_ENV_OBS_WORDS; y++) {
+                observation[y] |= lanes->machines[i].video[y];
+            }
+        }
+    }
+    return done;
+}
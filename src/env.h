@@ -0,0 +1,39 @@
+#ifndef CHIP8_ENV
+#define CHIP8_ENV
+#include <stdint.h>
+#include "cpu.h"
+#include "lanes.h"
+
+// words in the observation of one machine, its screen as in `struct Chip8.video`: a row per word, the leftmost pixel in the top bit
+#define CHIP8_ENV_OBS_WORDS VIDEO_H
+
+// A batch of machines running the same ROM, to be driven by an agent instead of a window.
+// Every step holds down the keys each machine is given for some frames and writes the
+// screens they end up with back to back into a buffer of the caller's,
+// `count * CHIP8_ENV_OBS_WORDS` words. The machines run on the lanes, and nothing is
+// allocated after chip8_env_new.
+struct Chip8Env {
+    struct Chip8Lanes *lanes;
+    // the machine right after the ROM was loaded, which every reset starts over from
+    struct Chip8 start;
+    // instructions per frame
+    int ipf;
+    // when true a step observes the OR of the screens of every frame it ran instead of
+    // just the last one, so sprites that are drawn and erased between frames still show up
+    bool max_pool;
+};
+
+struct Chip8Env *chip8_env_new(const char *restrict filename, int count);
+void chip8_env_free(struct Chip8Env *env);
+
+// starts every machine over, each with its own RNG state derived from `seed`,
+// and writes their first observations if `observations` isn't NULL
+void chip8_env_reset(struct Chip8Env *env, uint64_t seed, uint64_t *observations);
+// the same for a single machine, e.g. one whose episode ended, `observation` being its own
+void chip8_env_reset_one(struct Chip8Env *env, int machine, uint64_t seed, uint64_t *observation);
+
+// runs `frames` frames (the frame skip, at least 1, exits otherwise) on every machine with the keys of `actions` held down,
+// a bitmask per machine where bit k is key k, or none at all if `actions` is NULL.
+// returns the instructions run across all machines
+long chip8_env_step(struct Chip8Env *env, const uint16_t *actions, int frames, uint64_t *observations);
+#endif
@@ -0,0 +1,51 @@
+#include <string.h>
+#include "frame.h"
+
+#define FRAME_FRESH 0x4
+#define FRAME_INDEX 0x3
+
+void chip8_frames_init(struct Chip8Frames *frames) {
+    memset(frames->frames, 0, sizeof(frames->frames));
+    frames->front = 0;
+    atomic_init(&frames->middle, 1);
+    frames->back = 2;
+    frames->unseen_rows = 0;
+}
+
+void chip8_frames_publish(struct Chip8Frames *frames, struct Chip8 *chip8) {
+    // the consumer saw everything published so far once it took the last frame. if it didn't,
+    // it may still take it before the exchange below, and then only redraws a few rows twice
+    if (!(atomic_load(&frames->middle) & FRAME_FRESH)) {
+        frames->unseen_rows = 0;
+    }
+
+    struct Chip8Frame *frame = &frames->frames[frames->back];
+    memcpy(frame->video, chip8->video, sizeof(frame->video));
+    frame->dirty_rows = chip8->dirty_rows | frames->unseen_rows;
+    chip8->dirty_rows = 0;
+    frames->unseen_rows = frame->dirty_rows;
+
+    const uint8_t old = atomic_exchange(&frames->middle, frames->back | FRAME_FRESH);
+    frames->back = old & FRAME_INDEX;
+}
+
+const struct Chip8Frame *chip8_frames_take(struct Chip8Frames *frames) {
+    if (!(atomic_load(&frames->middle) & FRAME_FRESH)) {
+        return NULL;
+    }
+
+    const uint8_t old = atomic_exchange(&frames->middle, frames->front);
+    frames->front = old & FRAME_INDEX;
+    return &frames->frames[frames->front];
+}
+
+void chip8_frame_pixels(const uint64_t *video, int first, int last, uint32_t fg, uint32_t bg, void *pixels, int pitch) {
+    // the colour of every pixel is picked without branching: bg, or bg flipped into fg
+    const uint32_t flip = fg ^ bg;
+    for (int y = first; y <= last; y++) {
+        uint32_t *line = (uint32_t *)((uint8_t *)pixels + (y - first) * pitch);
+        for (size_t x = 0; x < VIDEO_W; x++) {
+            line[x] = bg ^ (flip & -(uint32_t)VIDEO_PIXEL(video, x, y));
+        }
+    }
+}
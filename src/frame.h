@@ -0,0 +1,41 @@
+#ifndef CHIP8_FRAME
+#define CHIP8_FRAME
+#include <stdatomic.h>
+#include "cpu.h"
+
+// a finished frame, as it gets handed to whoever shows it
+struct Chip8Frame {
+    uint64_t video[VIDEO_H];
+    // rows that changed since the previous frame that was taken
+    uint32_t dirty_rows;
+};
+
+// Hands frames from the emulation thread to the render thread without locks or waiting:
+// the producer fills `back`, the consumer reads `front`, and they trade frames
+// through `middle` with a single atomic exchange each, so neither ever blocks the other.
+struct Chip8Frames {
+    struct Chip8Frame frames[3];
+    // index of the middle frame, with FRAME_FRESH set while it hasn't been taken
+    _Atomic(uint8_t) middle;
+    // only touched by the producer
+    uint8_t back;
+    // rows of the frames published since the consumer last took one, which the next
+    // frame has to hold too in case they're replaced before being taken
+    uint32_t unseen_rows;
+    // only touched by the consumer
+    uint8_t front;
+};
+
+void chip8_frames_init(struct Chip8Frames *frames);
+
+// publishes the current screen of `chip8` as the newest frame, and takes its dirty rows
+void chip8_frames_publish(struct Chip8Frames *frames, struct Chip8 *chip8);
+
+// returns the newest frame, NULL if nothing was published since the last call.
+// the frame stays valid until the next call
+const struct Chip8Frame *chip8_frames_take(struct Chip8Frames *frames);
+
+// writes rows `first` to `last` of `video` to `pixels` as 0xAARRGGBB, `fg` for lit pixels and `bg`
+// for unlit ones, with every row `pitch` bytes after the previous one
+void chip8_frame_pixels(const uint64_t *video, int first, int last, uint32_t fg, uint32_t bg, void *pixels, int pitch);
+#endif
@@ -0,0 +1,32 @@
+#include "input.h"
+
+void chip8_input_init(struct Chip8Input *input) {
+    atomic_init(&input->head, 0);
+    atomic_init(&input->tail, 0);
+}
+
+bool chip8_input_push(struct Chip8Input *input, struct Chip8InputEvent event) {
+    const uint32_t head = atomic_load_explicit(&input->head, memory_order_relaxed);
+    const uint32_t tail = atomic_load_explicit(&input->tail, memory_order_acquire);
+    if (head - tail == INPUT_QUEUESIZ) {
+        return false;
+    }
+
+    input->events[head & (INPUT_QUEUESIZ - 1)] = event;
+    // the event is written before the consumer can see it
+    atomic_store_explicit(&input->head, head + 1, memory_order_release);
+    return true;
+}
+
+bool chip8_input_pop(struct Chip8Input *input, struct Chip8InputEvent *event) {
+    const uint32_t tail = atomic_load_explicit(&input->tail, memory_order_relaxed);
+    const uint32_t head = atomic_load_explicit(&input->head, memory_order_acquire);
+    if (tail == head) {
+        return false;
+    }
+
+    *event = input->events[tail & (INPUT_QUEUESIZ - 1)];
+    // and read before the producer can write over it
+    atomic_store_explicit(&input->tail, tail + 1, memory_order_release);
+    return true;
+}
@@ -0,0 +1,33 @@
+#ifndef CHIP8_INPUT
+#define CHIP8_INPUT
+#include <stdatomic.h>
+#include "cpu.h"
+
+// events that can be queued, holds a power of 2
+#define INPUT_QUEUESIZ 256
+
+// what an input event is about besides keys 0 to F of the keypad
+#define CHIP8_INPUT_REWIND 0x10
+
+// keys only reach the machine between frames, so an event is just the key and which way it went
+struct Chip8InputEvent {
+    uint8_t key;
+    bool down;
+};
+
+// Hands input events from the thread that polls them to the one running the emulation,
+// in order and without locks: the producer only ever moves `head` and the consumer `tail`,
+// each on a cache line of its own.
+struct Chip8Input {
+    struct Chip8InputEvent events[INPUT_QUEUESIZ];
+    _Alignas(64) _Atomic(uint32_t) head;
+    _Alignas(64) _Atomic(uint32_t) tail;
+};
+
+void chip8_input_init(struct Chip8Input *input);
+
+// queues an event, returns false (dropping it) if the consumer fell a whole queue behind
+bool chip8_input_push(struct Chip8Input *input, struct Chip8InputEvent event);
+// takes the oldest event, returns false if there are none
+bool chip8_input_pop(struct Chip8Input *input, struct Chip8InputEvent *event);
+#endif
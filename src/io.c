@@ -1,54 +1,99 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_thread.h>
 #include <stdbool.h>
-#include <math.h>
 #include "cpu.h"
+#include "io.h"
+#include "frame.h"
 
 #define WIN_H 400
 #define WIN_W 800
 
 static SDL_Window *window = NULL;
 static SDL_Renderer *renderer = NULL;
+// the framebuffer at its native resolution, scaled up to the window when copied
+static SDL_Texture *texture = NULL;
+static struct Chip8VideoOptions options;
+// without vsync presenting doesn't block, so frames are paced by hand
+static bool vsync = false;
+static uint64_t next_frame = 0;
 
 // should only be modified by the input
 _Atomic(bool) running = true;
 
-void chip8_video_draw(struct Chip8 *const chip8) {
-    uint32_t *video = chip8->video;
+// whole window has to be drawn again, e.g. after it was uncovered
+static _Atomic(bool) redraw = true;
 
-    SDL_Rect pixel = {
-        .h = WIN_W / VIDEO_W,
-        .w = WIN_H / VIDEO_H,
-    };
-    for (size_t y = 0; y < VIDEO_H; y++) {
-        for (size_t x = 0; x < VIDEO_W;  x++) {
-            pixel.x = x * pixel.w;
-            pixel.y = y * pixel.h;
+// waits out the rest of the frame when presenting didn't already wait for vsync
+static void chip8_video_pace(void) {
+    const uint64_t freq = SDL_GetPerformanceFrequency();
+    const uint64_t now = SDL_GetPerformanceCounter();
+    next_frame += freq / FRAMERATE;
+    if (next_frame < now) {
+        next_frame = now;
+    }
+    SDL_Delay((next_frame - now) * 1000 / freq);
+}
 
-            uint32_t vid_pixel = video[y * VIDEO_W + x];
-            if (vid_pixel == 0xFFFFFFFF) {
-                SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
-            } else {
-                SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0xFF);
-            }
+void chip8_video_draw(const struct Chip8Frame *frame) {
+    static const uint64_t *video = NULL;
+    uint32_t dirty = 0;
+    if (frame) {
+        video = frame->video;
+        dirty = frame->dirty_rows;
+    }
+    if (redraw && video) {
+        redraw = false;
+        dirty = UINT32_MAX;
+    }
 
-            SDL_RenderFillRect(renderer, &pixel);
-        }
+    // nothing changed, there is nothing to upload or present
+    if (!dirty) {
+        chip8_video_pace();
+        return;
     }
 
+    // only the rows from the first to the last dirty one are uploaded
+    int first = 0;
+    while (!(dirty & 1u << first)) {
+        ++first;
+    }
+    int last = VIDEO_H - 1;
+    while (!(dirty & 1u << last)) {
+        --last;
+    }
+
+    const SDL_Rect rows = { .x = 0, .y = first, .w = VIDEO_W, .h = last - first + 1 };
+    void *pixels;
+    int pitch;
+    if (SDL_LockTexture(texture, &rows, &pixels, &pitch) == 0) {
+        chip8_frame_pixels(video, first, last, options.fg, options.bg, pixels, pitch);
+        SDL_UnlockTexture(texture);
+    }
+
+    SDL_RenderCopy(renderer, texture, NULL, NULL);
     SDL_RenderPresent(renderer);
+
+    if (!vsync) {
+        chip8_video_pace();
+    }
 }
 
 void chip8_quit_video(void) {
+    SDL_DestroyTexture(texture);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
+    texture = NULL;
     renderer = NULL;
     window = NULL;
 }
 
-void chip8_init_video(const struct Chip8 *chip8) {
+void chip8_init_video(const struct Chip8VideoOptions *video_options) {
+    options = *video_options;
+
     SDL_Init(SDL_INIT_VIDEO);
+    // must be set before the texture is created
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, options.smooth ? "linear" : "nearest");
     window = SDL_CreateWindow("Chip8 Emulator",  SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, WIN_W, WIN_H, SDL_WINDOW_SHOWN);
     renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
     if (!window) {
@@ -60,199 +105,93 @@ void chip8_init_video(const struct Chip8 *chip8) {
         fputs("Error: Couldn't create renderer.", stderr);
         exit(1);
     }
+
+    SDL_RendererInfo info;
+    vsync = SDL_GetRendererInfo(renderer, &info) == 0 && (info.flags & SDL_RENDERER_PRESENTVSYNC);
+
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, VIDEO_W, VIDEO_H);
+    if (!texture) {
+        fputs("Error: Couldn't create texture.", stderr);
+        exit(1);
+    }
 }
 
-void chip8_capture_input(struct Chip8 *chip8) {
+// what every key of the host keyboard is, by where it is rather than what's printed on it:
+// the 4x4 block from 1 to V is the keypad, laid out as on the COSMAC VIP
+#define KEYMAP_SET 0x80
+static const uint8_t keymap[SDL_NUM_SCANCODES] = {
+    [SDL_SCANCODE_1] = KEYMAP_SET | 0x1,
+    [SDL_SCANCODE_2] = KEYMAP_SET | 0x2,
+    [SDL_SCANCODE_3] = KEYMAP_SET | 0x3,
+    [SDL_SCANCODE_4] = KEYMAP_SET | 0xC,
+    [SDL_SCANCODE_Q] = KEYMAP_SET | 0x4,
+    [SDL_SCANCODE_W] = KEYMAP_SET | 0x5,
+    [SDL_SCANCODE_E] = KEYMAP_SET | 0x6,
+    [SDL_SCANCODE_R] = KEYMAP_SET | 0xD,
+    [SDL_SCANCODE_A] = KEYMAP_SET | 0x7,
+    [SDL_SCANCODE_S] = KEYMAP_SET | 0x8,
+    [SDL_SCANCODE_D] = KEYMAP_SET | 0x9,
+    [SDL_SCANCODE_F] = KEYMAP_SET | 0xE,
+    [SDL_SCANCODE_Z] = KEYMAP_SET | 0xA,
+    [SDL_SCANCODE_X] = KEYMAP_SET | 0x0,
+    [SDL_SCANCODE_C] = KEYMAP_SET | 0xB,
+    [SDL_SCANCODE_V] = KEYMAP_SET | 0xF,
+    [SDL_SCANCODE_BACKSPACE] = KEYMAP_SET | CHIP8_INPUT_REWIND,
+};
+
+void chip8_capture_input(struct Chip8Input *input) {
     SDL_Event e;
     while (SDL_PollEvent(&e)) {
         if (e.type == SDL_QUIT) {
             running = false;
         }
 
-        if (e.type == SDL_KEYDOWN) {
-            switch (e.key.keysym.sym) {
-                case SDLK_x:
-                    chip8->keypad[0] = 1;
-                break;
-
-                case SDLK_1:
-                    chip8->keypad[1] = 1;
-                break;
-
-                case SDLK_2:
-                    chip8->keypad[2] = 1;
-                break;
-
-                case SDLK_3:
-                    chip8->keypad[3] = 1;
-                break;
-
-                case SDLK_q:
-                    chip8->keypad[4] = 1;
-                break;
-
-                case SDLK_w:
-                    chip8->keypad[5] = 1;
-                break;
-
-                case SDLK_e:
-                    chip8->keypad[6] = 1;
-                break;
-
-                case SDLK_a:
-                    chip8->keypad[7] = 1;
-                break;
-
-                case SDLK_s:
-                    chip8->keypad[8] = 1;
-                break;
-
-                case SDLK_d:
-                    chip8->keypad[9] = 1;
-                break;
-
-                case SDLK_z:
-                    chip8->keypad[0xA] = 1;
-                break;
-
-                case SDLK_c:
-                    chip8->keypad[0xB] = 1;
-                break;
-
-                case SDLK_4:
-                    chip8->keypad[0xC] = 1;
-                break;
-
-                case SDLK_r:
-                    chip8->keypad[0xD] = 1;
-                break;
-
-                case SDLK_f:
-                    chip8->keypad[0xE] = 1;
-                break;
-
-                case SDLK_v:
-                    chip8->keypad[0xF] = 1;
-                break;
-            }
+        if (e.type == SDL_WINDOWEVENT) {
+            redraw = true;
         }
 
-        if (e.type == SDL_KEYUP) {
-            switch (e.key.keysym.sym) {
-                case SDLK_x:
-                    chip8->keypad[0] = 0;
-                break;
-
-                case SDLK_1:
-                    chip8->keypad[1] = 0;
-                break;
-
-                case SDLK_2:
-                    chip8->keypad[2] = 0;
-                break;
-
-                case SDLK_3:
-                    chip8->keypad[3] = 0;
-                break;
-
-                case SDLK_q:
-                    chip8->keypad[4] = 0;
-                break;
-
-                case SDLK_w:
-                    chip8->keypad[5] = 0;
-                break;
-
-                case SDLK_e:
-                    chip8->keypad[6] = 0;
-                break;
-
-                case SDLK_a:
-                    chip8->keypad[7] = 0;
-                break;
-
-                case SDLK_s:
-                    chip8->keypad[8] = 0;
-                break;
-
-                case SDLK_d:
-                    chip8->keypad[9] = 0;
-                break;
-
-                case SDLK_z:
-                    chip8->keypad[0xA] = 0;
-                break;
-
-                case SDLK_c:
-                    chip8->keypad[0xB] = 0;
-                break;
-
-                case SDLK_4:
-                    chip8->keypad[0xC] = 0;
-                break;
-
-                case SDLK_r:
-                    chip8->keypad[0xD] = 0;
-                break;
-
-                case SDLK_f:
-                    chip8->keypad[0xE] = 0;
-                break;
-
-                case SDLK_v:
-                    chip8->keypad[0xF] = 0;
-                break;
+        // held keys repeat, but only their first press is news
+        if ((e.type == SDL_KEYDOWN && !e.key.repeat) || e.type == SDL_KEYUP) {
+            const SDL_Scancode scancode = e.key.keysym.scancode;
+            const uint8_t key = scancode >= 0 && scancode < SDL_NUM_SCANCODES ? keymap[scancode] : 0;
+            if (key & KEYMAP_SET) {
+                chip8_input_push(input, (struct Chip8InputEvent) {
+                    .key = key & ~KEYMAP_SET,
+                    .down = e.type == SDL_KEYDOWN,
+                });
             }
         }
     }
 }
 
-void chip8_init_input(struct Chip8 *chip8) {
+void chip8_init_input(struct Chip8Input *input) {
     if (SDL_Init(SDL_INIT_EVENTS) < 0) {
         fputs("Error: Could not initialize SDL events.", stderr);
         exit(1);
     }
+    chip8_input_init(input);
 }
 
-void chip8_play_audio(struct Chip8 *const chip8) {
-    if (chip8->sound_timer > 0) {
-        SDL_PauseAudio(0);
-    } else {
-        SDL_PauseAudio(1);
-    }
-}
-
-#define AMPLITUDE 28000
-#define SAMPLE_RATE 44100
-#define M_PI 3.14159265358979323846
-
 static void chip8_audio_callback(void *userdata, uint8_t *raw_buffer, int bytes) {
-    int16_t *buffer = (int16_t *)raw_buffer;
-    int len = bytes / 2;
-    int sample_nr = 0;
-
-    for (int i = 0; i < len; i++, sample_nr++) {
-        double time = sample_nr / (double)SAMPLE_RATE;
-        buffer[i] = AMPLITUDE * sin(2.0f * M_PI * 441.0f * time);
-    }
+    chip8_audio_render(userdata, (int16_t *)raw_buffer, bytes / sizeof(int16_t));
 }
 
 void chip8_quit_audio(void) {
     SDL_CloseAudio();
 }
 
-void chip8_init_audio(const struct Chip8 *chip8) {
+void chip8_init_audio(struct Chip8Audio *audio, int samples) {
     if(SDL_Init(SDL_INIT_AUDIO) < 0) {
         fputs("Error: Could not initialize SDL audio.", stderr);
         exit(1);
     }
 
     SDL_AudioSpec desired = {
-        .freq = SAMPLE_RATE,
+        .freq = AUDIO_RATE,
         .format = AUDIO_S16SYS,
         .channels = 1,
-        .samples = 2048,
-        .userdata = NULL,
+        .samples = samples,
+        .userdata = audio,
         .callback = chip8_audio_callback,
     };
     SDL_AudioSpec obtained;
@@ -261,8 +200,13 @@ void chip8_init_audio(const struct Chip8 *chip8) {
         exit(1);
     }
 
-    if (obtained.format != desired.format) {
+    if (obtained.format != desired.format || obtained.channels != desired.channels) {
         fputs("Error: Didn't receive the correct audio format from SDL.", stderr);
         exit(1);
     }
+
+    // the device may not play at the rate asked for
+    chip8_audio_init(audio, obtained.freq);
+    // the callback plays silence while the tone is off, so the device never has to be paused
+    SDL_PauseAudio(0);
 }
@@ -1,17 +1,30 @@
 #ifndef CHIP8_IO
 #define CHIP8_IO
 #include "cpu.h"
+#include "frame.h"
+#include "input.h"
+#include "audio.h"
 
 extern _Atomic(bool) running;
 
-void chip8_init_video(const struct Chip8 *chip8);
-void chip8_video_draw(struct Chip8 *const chip8);
+struct Chip8VideoOptions {
+    // colours of lit and unlit pixels, as 0xAARRGGBB
+    uint32_t fg;
+    uint32_t bg;
+    // scale the screen up with linear filtering instead of keeping sharp pixels
+    bool smooth;
+};
+
+void chip8_init_video(const struct Chip8VideoOptions *options);
+// draws the newest frame, or waits out the frame if `frame` is NULL (nothing new was published)
+void chip8_video_draw(const struct Chip8Frame *frame);
 void chip8_quit_video(void);
 
-void chip8_init_audio(const struct Chip8 *chip8);
-void chip8_play_audio(struct Chip8 *const chip8);
+// opens the audio device with a buffer of `samples` samples, playing what's queued into `audio`
+void chip8_init_audio(struct Chip8Audio *audio, int samples);
 void chip8_quit_audio(void);
 
-void chip8_init_input(struct Chip8 *chip8);
-void chip8_capture_input(struct Chip8 *chip8);
+void chip8_init_input(struct Chip8Input *input);
+// polls the window's events on the thread that created it, queueing the keys for the emulation
+void chip8_capture_input(struct Chip8Input *input);
 #endif
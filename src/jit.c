@@ -0,0 +1,708 @@
+// needed for MAP_ANONYMOUS and sysconf
+#define _DEFAULT_SOURCE
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jit.h"
+#include "cache.h"
+
+#if defined(__x86_64__) && defined(__unix__)
+#include <sys/mman.h>
+#include <unistd.h>
+#include "opcode.h"
+
+// times a block has to be run before it gets translated
+#define JIT_HOT 16
+// native code is bump allocated out of a single arena, which is flushed as a whole once full
+#define JIT_ARENASIZ (1 << 20)
+// the most native code a single instruction is translated into: Fx55 or Fx65 copying every
+// register, or a handler storing and loading back every register around it
+#define JIT_INSTSIZ 512
+// the most native code around the instructions of a block: loading and storing its registers and leaving it
+#define JIT_BLOCKSIZ 512
+
+// runs the native code at `code` with rbx and ebp set up (see below), and returns what's left
+// of `budget` once it gets to a block it can't go straight on to
+typedef int (*jit_enter)(struct Chip8 *chip8, int budget, const uint8_t *code);
+
+struct Chip8Jit {
+    uint8_t *code[MEMORYSIZ];
+    // the same, for the blocks that other blocks go straight on to: all but the ones idle loops
+    // start at, which are left to chip8_run_block to go around all at once
+    uint8_t *chain[MEMORYSIZ];
+    // amount of instructions in the translated block starting at every address
+    uint8_t len[MEMORYSIZ];
+    uint8_t heat[MEMORYSIZ];
+    // never writable and executable at once: code is written while its pages are
+    // read/write, and they are made read/execute before it runs
+    uint8_t *arena;
+    size_t used;
+    size_t page;
+    // the way into native code and back out of it, at the start of the arena and never flushed
+    jit_enter enter;
+    const uint8_t *leave;
+    size_t stubs;
+};
+
+// sets the protection of the pages holding the bytes of the arena from `from` up to `to`
+static void jit_protect(struct Chip8Jit *jit, size_t from, size_t to, int prot) {
+    const size_t first = from & ~(jit->page - 1);
+    if (mprotect(jit->arena + first, to - first, prot) != 0) {
+        fputs("Error: Could not change the protection of the native code.", stderr);
+        exit(1);
+    }
+}
+
+// The chip8 pointer is pinned to rbx and what's left of the budget to ebp while native code runs.
+// The CHIP-8 registers a block uses are held in host registers from its start to its end, the first
+// ones it uses at least (there are too few for all of V0-VF and I), the rest are used straight from
+// memory. They're only stored when the block is left or a handler is called, which is also the only
+// time the PC, known while translating, is stored. A block ends by jumping straight to the next one.
+#define REG(r) (int32_t)(offsetof(struct Chip8, registers) + (r))
+#define PC (int32_t)offsetof(struct Chip8, pc)
+#define INDEX (int32_t)offsetof(struct Chip8, index)
+#define MEMORY (int32_t)offsetof(struct Chip8, memory)
+#define STACK (int32_t)offsetof(struct Chip8, stack)
+#define SP (int32_t)offsetof(struct Chip8, sp)
+#define KEYPAD (int32_t)offsetof(struct Chip8, keypad)
+#define DELAY_TIMER (int32_t)offsetof(struct Chip8, delay_timer)
+#define SOUND_TIMER (int32_t)offsetof(struct Chip8, sound_timer)
+
+// register numbers, as encoded in instructions
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+#define NONE 0xFF
+// the arithmetic instructions, as encoded in their opcodes (and in the ModRM of their immediate forms)
+enum { ADD = 0, OR = 1, AND = 4, SUB = 5, XOR = 6, CMP = 7 };
+// condition codes, as encoded in jcc and setcc
+enum { CC_B = 0x2, CC_E = 0x4, CC_NE = 0x5, CC_A = 0x7, CC_L = 0xC };
+
+// what the registers of a block are held in, the ones handlers leave alone first
+static const uint8_t jit_pool[] = { R12, R13, R14, R15, RSI, RDI, R8, R9, R10, R11 };
+#define JIT_POOLSIZ (sizeof(jit_pool) / sizeof(jit_pool[0]))
+// I is held in a host register the same way, as if it came after VF
+#define JIT_I REGISTERSIZ
+
+// an operand: a host register, or the memory at [rbx + index + disp] (with no index if it's NONE)
+struct JitArg {
+    uint8_t reg;
+    uint8_t index;
+    int32_t disp;
+};
+
+static struct JitArg jit_reg(uint8_t reg) {
+    return (struct JitArg){ .reg = reg, .index = NONE };
+}
+
+static struct JitArg jit_mem(uint8_t index, int32_t disp) {
+    return (struct JitArg){ .reg = NONE, .index = index, .disp = disp };
+}
+
+static void emit(uint8_t **p, size_t n, const uint8_t *bytes) {
+    memcpy(*p, bytes, n);
+    *p += n;
+}
+
+#define EMIT(p, ...) emit(p, sizeof((uint8_t[]){__VA_ARGS__}), (uint8_t[]){__VA_ARGS__})
+
+static void emit32(uint8_t **p, uint32_t value) {
+    memcpy(*p, &value, sizeof(value));
+    *p += sizeof(value);
+}
+
+static void emit64(uint8_t **p, uint64_t value) {
+    memcpy(*p, &value, sizeof(value));
+    *p += sizeof(value);
+}
+
+// `op` (two bytes when it starts with 0x0F) on operands of `size` bytes, with `reg` in the ModRM
+// reg field and `rm` as the other operand. `reg` is an opcode extension when `ext` is set
+static void emit_encode(uint8_t **p, int size, uint16_t op, uint8_t reg, bool ext, struct JitArg rm) {
+    if (size == 2) {
+        EMIT(p, 0x66);
+    }
+    const bool direct = rm.reg != NONE;
+    uint8_t rex = (size == 8) << 3 | (reg >> 3) << 2;
+    if (direct) {
+        rex |= rm.reg >> 3;
+    } else if (rm.index != NONE) {
+        rex |= (rm.index >> 3) << 1;
+    }
+    // the byte registers from 4 on are spl-dil with a REX prefix and ah-bh without one
+    if (rex || (size == 1 && ((!ext && reg >= RSP) || (direct && rm.reg >= RSP)))) {
+        EMIT(p, 0x40 | rex);
+    }
+    if (op > 0xFF) {
+        EMIT(p, op >> 8);
+    }
+    EMIT(p, op & 0xFF);
+
+    if (direct) {
+        EMIT(p, 0xC0 | (reg & 7) << 3 | (rm.reg & 7));
+        return;
+    }
+    const uint8_t mod = rm.disp ? 0x80 : 0x00;
+    if (rm.index == NONE) {
+        EMIT(p, mod | (reg & 7) << 3 | RBX);
+    } else {
+        EMIT(p, mod | (reg & 7) << 3 | RSP, (rm.index & 7) << 3 | RBX);
+    }
+    if (rm.disp) {
+        emit32(p, rm.disp);
+    }
+}
+
+static void emit_op(uint8_t **p, int size, uint16_t op, uint8_t reg, struct JitArg rm) {
+    emit_encode(p, size, op, reg, false, rm);
+}
+
+static void emit_ext(uint8_t **p, int size, uint16_t op, uint8_t ext, struct JitArg rm) {
+    emit_encode(p, size, op, ext, true, rm);
+}
+
+// mov dst, src on bytes, through al when both are in memory
+static void emit_mov8(uint8_t **p, struct JitArg dst, struct JitArg src) {
+    if (src.reg != NONE) {
+        emit_op(p, 1, 0x88, src.reg, dst);
+    } else if (dst.reg != NONE) {
+        emit_op(p, 1, 0x8A, dst.reg, src);
+    } else {
+        emit_op(p, 1, 0x8A, RAX, src);
+        emit_op(p, 1, 0x88, RAX, dst);
+    }
+}
+
+// <alu> dst, src on bytes, the same way
+static void emit_alu8(uint8_t **p, uint8_t alu, struct JitArg dst, struct JitArg src) {
+    if (src.reg != NONE) {
+        emit_op(p, 1, alu << 3, src.reg, dst);
+    } else if (dst.reg != NONE) {
+        emit_op(p, 1, alu << 3 | 0x02, dst.reg, src);
+    } else {
+        emit_op(p, 1, 0x8A, RAX, src);
+        emit_op(p, 1, alu << 3, RAX, dst);
+    }
+}
+
+// mov word [pc], imm16
+static void emit_set_pc(uint8_t **p, uint16_t pc) {
+    emit_ext(p, 2, 0xC7, 0, jit_mem(NONE, PC));
+    EMIT(p, pc & 0xFF, pc >> 8);
+}
+
+// jcc rel32 to somewhere not written yet, returns what to hand emit_patch once it is
+static uint8_t *emit_jcc(uint8_t **p, uint8_t cc) {
+    EMIT(p, 0x0F, 0x80 | cc);
+    emit32(p, 0);
+    return *p;
+}
+
+static void emit_patch(uint8_t *jump, const uint8_t *target) {
+    const int32_t rel = target - jump;
+    memcpy(jump - sizeof(rel), &rel, sizeof(rel));
+}
+
+// jmp rel32
+static void emit_jmp(uint8_t **p, const uint8_t *target) {
+    EMIT(p, 0xE9);
+    emit32(p, target - (*p + sizeof(int32_t)));
+}
+
+// a block being translated
+struct JitBlock {
+    uint8_t *p;
+    const struct Chip8Jit *jit;
+    // the host register every one of V0-VF and I is held in, NONE for the ones used from memory
+    uint8_t host[REGISTERSIZ + 1];
+    // a bit for every one of them written since it was loaded
+    uint32_t dirty;
+};
+
+// where register `r` (or I) is while the block runs
+static struct JitArg jit_read(const struct JitBlock *b, uint8_t r) {
+    if (b->host[r] != NONE) {
+        return jit_reg(b->host[r]);
+    }
+    return jit_mem(NONE, r == JIT_I ? INDEX : REG(r));
+}
+
+// the same, for writing it
+static struct JitArg jit_write(struct JitBlock *b, uint8_t r) {
+    if (b->host[r] != NONE) {
+        b->dirty |= 1u << r;
+    }
+    return jit_read(b, r);
+}
+
+// loads the registers of `mask` that are held in host registers
+static void jit_load(struct JitBlock *b, uint32_t mask) {
+    for (uint8_t r = 0; r <= JIT_I; r++) {
+        if (b->host[r] != NONE && mask & 1u << r) {
+            // movzx host, byte [Vx] / word [index]
+            emit_op(&b->p, 4, r == JIT_I ? 0x0FB7 : 0x0FB6, b->host[r], jit_mem(NONE, r == JIT_I ? INDEX : REG(r)));
+        }
+    }
+}
+
+// stores the registers written since they were loaded, before leaving the block or calling a handler
+static void jit_spill(struct JitBlock *b) {
+    for (uint8_t r = 0; r <= JIT_I; r++) {
+        if (b->dirty & 1u << r) {
+            // mov [Vx], host8 / mov [index], host16
+            emit_op(&b->p, r == JIT_I ? 2 : 1, r == JIT_I ? 0x89 : 0x88, b->host[r], jit_mem(NONE, r == JIT_I ? INDEX : REG(r)));
+        }
+    }
+    b->dirty = 0;
+}
+
+// reg = MEMORY_ADDR(I + offset)
+static void jit_addr(struct JitBlock *b, uint8_t reg, uint8_t offset) {
+    emit_op(&b->p, 4, 0x0FB7, reg, jit_read(b, JIT_I));
+    if (offset) {
+        emit_ext(&b->p, 4, 0x83, ADD, jit_reg(reg));
+        EMIT(&b->p, offset);
+    }
+    emit_ext(&b->p, 4, 0x81, AND, jit_reg(reg));
+    emit32(&b->p, MEMORYSIZ - 1);
+}
+
+// goes on to the block at `target`, or back to chip8_jit_run if it has no native code
+static void jit_exit(struct JitBlock *b, uint16_t target) {
+    if (target < MEMORYSIZ - 1) {
+        // mov rax, &chain[target]; mov rax, [rax]; test rax, rax; jz 1f; jmp rax; 1:
+        EMIT(&b->p, 0x48, 0xB8);
+        emit64(&b->p, (uintptr_t)&b->jit->chain[target]);
+        EMIT(&b->p, 0x48, 0x8B, 0x00, 0x48, 0x85, 0xC0, 0x74, 0x02, 0xFF, 0xE0);
+    }
+    emit_set_pc(&b->p, target);
+    emit_jmp(&b->p, b->jit->leave);
+}
+
+// the same, for a target that's only known at run time, in ecx
+static void jit_exit_ecx(struct JitBlock *b) {
+    emit_op(&b->p, 2, 0x89, RCX, jit_mem(NONE, PC));
+    // and ecx, MEMORYSIZ - 1; mov rax, chain; mov rax, [rax + rcx * 8]; test rax, rax; jz leave; jmp rax
+    EMIT(&b->p, 0x81, 0xE1);
+    emit32(&b->p, MEMORYSIZ - 1);
+    EMIT(&b->p, 0x48, 0xB8);
+    emit64(&b->p, (uintptr_t)b->jit->chain);
+    EMIT(&b->p, 0x48, 0x8B, 0x04, 0xC8, 0x48, 0x85, 0xC0);
+    emit_patch(emit_jcc(&b->p, CC_E), b->jit->leave);
+    EMIT(&b->p, 0xFF, 0xE0);
+}
+
+// runs an instruction through its handler, which sees the registers in memory and the PC past the instruction
+static void jit_call(struct JitBlock *b, const struct Chip8Inst *inst, uint16_t next) {
+    jit_spill(b);
+    emit_set_pc(&b->p, next);
+    // mov rdi, rbx; mov rsi, inst; mov rax, exec; call rax
+    EMIT(&b->p, 0x48, 0x89, 0xDF, 0x48, 0xBE);
+    emit64(&b->p, (uintptr_t)inst);
+    EMIT(&b->p, 0x48, 0xB8);
+    emit64(&b->p, (uintptr_t)inst->exec);
+    EMIT(&b->p, 0xFF, 0xD0);
+}
+
+// drops the blocks decoded from the `size` bytes at I that Fx33 or Fx55 just wrote
+static void jit_invalidate(struct JitBlock *b, uint8_t size) {
+    emit_op(&b->p, 4, 0x0FB7, RSI, jit_read(b, JIT_I));
+    // mov rdi, rbx; mov edx, size; mov rax, chip8_invalidate; call rax
+    EMIT(&b->p, 0x48, 0x89, 0xDF, 0xBA);
+    emit32(&b->p, size);
+    EMIT(&b->p, 0x48, 0xB8);
+    emit64(&b->p, (uintptr_t)chip8_invalidate);
+    EMIT(&b->p, 0xFF, 0xD0);
+}
+
+// the registers (and I, as JIT_I) the native code of an instruction uses, a bit each,
+// none for the ones run by their handlers. `set` gets the ones it writes without reading them
+static uint32_t jit_uses(const struct Chip8Inst *inst, uint32_t *set) {
+    const uint32_t x = 1u << inst->x;
+    const uint32_t y = 1u << inst->y;
+    const uint32_t vf = 1u << VF;
+    const uint32_t index = 1u << JIT_I;
+    // V0 to Vx
+    const uint32_t upto = (2u << inst->x) - 1;
+    const chip8_op exec = inst->exec;
+
+    *set = 0;
+    if (exec == chip8_op_6xkk || exec == chip8_op_fx07) {
+        *set = x;
+        return x;
+    } else if (exec == chip8_op_8xy0) {
+        *set = x & ~y;
+        return x | y;
+    } else if (exec == chip8_op_annn) {
+        *set = index;
+        return index;
+    } else if (exec == chip8_op_fx29) {
+        *set = index;
+        return x | index;
+    } else if (exec == chip8_op_fx65) {
+        *set = upto;
+        return upto | index;
+    } else if (exec == chip8_op_3xkk || exec == chip8_op_4xkk || exec == chip8_op_7xkk || exec == chip8_op_ex9e
+               || exec == chip8_op_exa1 || exec == chip8_op_fx15 || exec == chip8_op_fx18) {
+        return x;
+    } else if (exec == chip8_op_5xy0 || exec == chip8_op_9xy0 || exec == chip8_op_8xy1 || exec == chip8_op_8xy2
+               || exec == chip8_op_8xy3) {
+        return x | y;
+    } else if (exec == chip8_op_8xy4 || exec == chip8_op_8xy5 || exec == chip8_op_8xy7) {
+        return x | y | vf;
+    } else if (exec == chip8_op_8xy6 || exec == chip8_op_8xye) {
+        return x | vf;
+    } else if (exec == chip8_op_fx1e || exec == chip8_op_fx33) {
+        return x | index;
+    } else if (exec == chip8_op_fx55) {
+        return upto | index;
+    } else if (exec == chip8_op_bnnn) {
+        return 1u << V0;
+    }
+
+    return 0;
+}
+
+// translates the instructions that are simple enough to be done inline,
+// returns false for the ones that have to go through their handler
+static bool jit_inline(struct JitBlock *b, const struct Chip8Inst *inst) {
+    uint8_t **const p = &b->p;
+    const uint8_t x = inst->x;
+    const uint8_t y = inst->y;
+    const chip8_op exec = inst->exec;
+
+    if (exec == chip8_op_6xkk) {
+        // mov Vx, kk
+        emit_ext(p, 1, 0xC6, 0, jit_write(b, x));
+        EMIT(p, inst->kk);
+    } else if (exec == chip8_op_7xkk) {
+        // add Vx, kk
+        emit_ext(p, 1, 0x80, ADD, jit_write(b, x));
+        EMIT(p, inst->kk);
+    } else if (exec == chip8_op_8xy0) {
+        emit_mov8(p, jit_write(b, x), jit_read(b, y));
+    } else if (exec == chip8_op_8xy1 || exec == chip8_op_8xy2 || exec == chip8_op_8xy3) {
+        emit_alu8(p, exec == chip8_op_8xy1 ? OR : exec == chip8_op_8xy2 ? AND : XOR, jit_write(b, x), jit_read(b, y));
+    } else if (exec == chip8_op_8xy4) {
+        // add Vx, Vy; setc VF
+        emit_alu8(p, ADD, jit_write(b, x), jit_read(b, y));
+        emit_ext(p, 1, 0x0F90 | CC_B, 0, jit_write(b, VF));
+    } else if (exec == chip8_op_8xy5) {
+        // sub Vx, Vy; cmp Vx, Vy; seta VF, the flag as the handler computes it
+        emit_alu8(p, SUB, jit_write(b, x), jit_read(b, y));
+        emit_alu8(p, CMP, jit_read(b, x), jit_read(b, y));
+        emit_ext(p, 1, 0x0F90 | CC_A, 0, jit_write(b, VF));
+    } else if (exec == chip8_op_8xy7) {
+        // mov al, Vy; sub al, Vx; mov Vx, al; cmp Vy, Vx; seta VF
+        emit_op(p, 1, 0x8A, RAX, jit_read(b, y));
+        emit_op(p, 1, SUB << 3 | 0x02, RAX, jit_read(b, x));
+        emit_op(p, 1, 0x88, RAX, jit_write(b, x));
+        emit_alu8(p, CMP, jit_read(b, y), jit_read(b, x));
+        emit_ext(p, 1, 0x0F90 | CC_A, 0, jit_write(b, VF));
+    } else if (exec == chip8_op_8xy6 || exec == chip8_op_8xye) {
+        // shr/shl Vx, 1; mov al, Vx; and al, 1; mov VF, al
+        emit_ext(p, 1, 0xD0, exec == chip8_op_8xy6 ? 5 : 4, jit_write(b, x));
+        emit_op(p, 1, 0x8A, RAX, jit_read(b, x));
+        EMIT(p, 0x24, 0x01);
+        emit_op(p, 1, 0x88, RAX, jit_write(b, VF));
+    } else if (exec == chip8_op_annn) {
+        // mov I, nnn
+        emit_ext(p, 2, 0xC7, 0, jit_write(b, JIT_I));
+        EMIT(p, inst->nnn & 0xFF, inst->nnn >> 8);
+    } else if (exec == chip8_op_fx07) {
+        emit_mov8(p, jit_write(b, x), jit_mem(NONE, DELAY_TIMER));
+    } else if (exec == chip8_op_fx15 || exec == chip8_op_fx18) {
+        emit_mov8(p, jit_mem(NONE, exec == chip8_op_fx15 ? DELAY_TIMER : SOUND_TIMER), jit_read(b, x));
+    } else if (exec == chip8_op_fx1e) {
+        // movzx eax, Vx; add I, ax
+        emit_op(p, 1, 0x0FB6, RAX, jit_read(b, x));
+        emit_op(p, 2, 0x01, RAX, jit_write(b, JIT_I));
+    } else if (exec == chip8_op_fx29) {
+        // movzx eax, Vx; imul eax, eax, 5; add eax, FONTADDR; mov I, ax
+        emit_op(p, 1, 0x0FB6, RAX, jit_read(b, x));
+        EMIT(p, 0x6B, 0xC0, 0x05, 0x05);
+        emit32(p, FONTADDR);
+        emit_op(p, 2, 0x89, RAX, jit_write(b, JIT_I));
+    } else if (exec == chip8_op_fx33) {
+        // the digits come from multiplying rather than dividing, Vx / 10 is Vx * 205 >> 11 for every byte.
+        // movzx eax, Vx; imul edx, eax, 205; shr edx, 11; imul ecx, edx, 10; sub eax, ecx
+        emit_op(p, 1, 0x0FB6, RAX, jit_read(b, x));
+        EMIT(p, 0x69, 0xD0);
+        emit32(p, 205);
+        EMIT(p, 0xC1, 0xEA, 11, 0x6B, 0xCA, 10, 0x29, 0xC8);
+        jit_addr(b, RCX, 2);
+        emit_op(p, 1, 0x88, RAX, jit_mem(RCX, MEMORY));
+        // imul eax, edx, 205; shr eax, 11; imul ecx, eax, 10; sub edx, ecx
+        EMIT(p, 0x69, 0xC2);
+        emit32(p, 205);
+        EMIT(p, 0xC1, 0xE8, 11, 0x6B, 0xC8, 10, 0x29, 0xCA);
+        jit_addr(b, RCX, 1);
+        emit_op(p, 1, 0x88, RDX, jit_mem(RCX, MEMORY));
+        jit_addr(b, RCX, 0);
+        emit_op(p, 1, 0x88, RAX, jit_mem(RCX, MEMORY));
+    } else if (exec == chip8_op_fx55) {
+        for (uint8_t i = V0; i <= x; i++) {
+            jit_addr(b, RCX, i);
+            emit_mov8(p, jit_mem(RCX, MEMORY), jit_read(b, i));
+        }
+    } else if (exec == chip8_op_fx65) {
+        for (uint8_t i = V0; i <= x; i++) {
+            jit_addr(b, RCX, i);
+            emit_mov8(p, jit_write(b, i), jit_mem(RCX, MEMORY));
+        }
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+// translates the instructions that end a block by going somewhere other than the next one,
+// leaving the block too. returns false for the ones that have to go through their handler
+static bool jit_branch(struct JitBlock *b, const struct Chip8Inst *inst, uint16_t next) {
+    uint8_t **const p = &b->p;
+    const uint8_t x = inst->x;
+    const chip8_op exec = inst->exec;
+
+    if (exec == chip8_op_1nnn) {
+        jit_spill(b);
+        jit_exit(b, inst->nnn);
+    } else if (exec == chip8_op_2nnn) {
+        // movzx eax, byte [sp]; inc eax; and eax, STACKSIZ - 1; mov [sp], al; add eax, eax; mov word [stack + rax], next
+        emit_op(p, 4, 0x0FB6, RAX, jit_mem(NONE, SP));
+        EMIT(p, 0xFF, 0xC0, 0x83, 0xE0, STACKSIZ - 1);
+        emit_op(p, 1, 0x88, RAX, jit_mem(NONE, SP));
+        EMIT(p, 0x01, 0xC0);
+        emit_ext(p, 2, 0xC7, 0, jit_mem(RAX, STACK));
+        EMIT(p, next & 0xFF, next >> 8);
+        jit_spill(b);
+        jit_exit(b, inst->nnn);
+    } else if (exec == chip8_op_00ee) {
+        // movzx eax, byte [sp]; and eax, STACKSIZ - 1; mov ecx, eax; add ecx, ecx; movzx ecx, word [stack + rcx]
+        emit_op(p, 4, 0x0FB6, RAX, jit_mem(NONE, SP));
+        EMIT(p, 0x83, 0xE0, STACKSIZ - 1, 0x89, 0xC1, 0x01, 0xC9);
+        emit_op(p, 4, 0x0FB7, RCX, jit_mem(RCX, STACK));
+        // dec eax; and eax, STACKSIZ - 1; mov [sp], al
+        EMIT(p, 0xFF, 0xC8, 0x83, 0xE0, STACKSIZ - 1);
+        emit_op(p, 1, 0x88, RAX, jit_mem(NONE, SP));
+        jit_spill(b);
+        jit_exit_ecx(b);
+    } else if (exec == chip8_op_bnnn) {
+        // movzx ecx, V0; add ecx, nnn
+        emit_op(p, 1, 0x0FB6, RCX, jit_read(b, V0));
+        EMIT(p, 0x81, 0xC1);
+        emit32(p, inst->nnn);
+        jit_spill(b);
+        jit_exit_ecx(b);
+    } else {
+        // the skips compare, and then go on to `next` or past it on what they found
+        uint8_t skip_if;
+        if (exec == chip8_op_3xkk || exec == chip8_op_4xkk) {
+            // cmp Vx, kk
+            emit_ext(p, 1, 0x80, CMP, jit_read(b, x));
+            EMIT(p, inst->kk);
+            skip_if = exec == chip8_op_3xkk ? CC_E : CC_NE;
+        } else if (exec == chip8_op_5xy0 || exec == chip8_op_9xy0) {
+            emit_alu8(p, CMP, jit_read(b, x), jit_read(b, inst->y));
+            skip_if = exec == chip8_op_5xy0 ? CC_E : CC_NE;
+        } else if (exec == chip8_op_ex9e || exec == chip8_op_exa1) {
+            // movzx eax, Vx; and eax, KEYPADSIZ - 1; cmp byte [keypad + rax], 0
+            emit_op(p, 1, 0x0FB6, RAX, jit_read(b, x));
+            EMIT(p, 0x83, 0xE0, KEYPADSIZ - 1);
+            emit_ext(p, 1, 0x80, CMP, jit_mem(RAX, KEYPAD));
+            EMIT(p, 0);
+            skip_if = exec == chip8_op_ex9e ? CC_NE : CC_E;
+        } else {
+            return false;
+        }
+
+        // the registers are stored with movs, which leave the flags alone
+        jit_spill(b);
+        uint8_t *const skip = emit_jcc(p, skip_if);
+        jit_exit(b, next);
+        emit_patch(skip, *p);
+        jit_exit(b, next + 2);
+    }
+
+    return true;
+}
+
+static void jit_translate(struct Chip8Jit *jit, const struct Chip8 *chip8, uint16_t pc, const struct Chip8Inst *block, uint8_t len) {
+    const size_t worst = JIT_BLOCKSIZ + len * JIT_INSTSIZ;
+    if (jit->used + worst > JIT_ARENASIZ) {
+        memset(jit->code, 0, sizeof(jit->code));
+        memset(jit->chain, 0, sizeof(jit->chain));
+        memset(jit->len, 0, sizeof(jit->len));
+        // none of it runs anymore, so all of it can be written again
+        jit_protect(jit, 0, JIT_ARENASIZ, PROT_READ | PROT_WRITE);
+        jit->used = jit->stubs;
+    }
+
+    // the page the previous block ended in was made executable, this block starts in it too
+    jit_protect(jit, jit->used, jit->used + worst, PROT_READ | PROT_WRITE);
+    uint8_t *const start = jit->arena + jit->used;
+    struct JitBlock b = { .p = start, .jit = jit };
+
+    // the registers the block uses get host registers in the order it first uses them,
+    // and the ones it starts by writing don't have to be loaded
+    memset(b.host, NONE, sizeof(b.host));
+    size_t pool = 0;
+    uint32_t loaded = 0;
+    uint32_t written = 0;
+    for (uint8_t i = 0; i < len; i++) {
+        uint32_t set;
+        const uint32_t uses = jit_uses(&block[2 * i], &set);
+        for (uint8_t r = 0; r <= JIT_I; r++) {
+            if (uses & 1u << r && b.host[r] == NONE && pool < JIT_POOLSIZ) {
+                b.host[r] = jit_pool[pool++];
+            }
+        }
+        loaded |= uses & ~set & ~written;
+        written |= set;
+    }
+
+    // sub ebp, len; jl (see the end)
+    EMIT(&b.p, 0x83, 0xED, len);
+    uint8_t *const short_budget = emit_jcc(&b.p, CC_L);
+    jit_load(&b, loaded);
+
+    bool left = false;
+    for (uint8_t i = 0; i < len; i++) {
+        const struct Chip8Inst *inst = &block[2 * i];
+        const uint16_t next = pc + 2 * (i + 1);
+        const bool last = i + 1 == len;
+
+        // only the last instruction of a block branches
+        if (last && (inst->flags & CHIP8_INST_BRANCH) && jit_branch(&b, inst, next)) {
+            left = true;
+        } else if (!jit_inline(&b, inst)) {
+            jit_call(&b, inst, next);
+            if (inst->flags & CHIP8_INST_BRANCH) {
+                // wherever the handler put the PC, chip8_run_block takes it from there
+                emit_jmp(&b.p, jit->leave);
+                left = true;
+            } else if (!last) {
+                // the handler may have written any of them, and calls clobber half of the pool
+                jit_load(&b, ~0u);
+            }
+        }
+    }
+
+    if (!left) {
+        const struct Chip8Inst *inst = &block[2 * (len - 1)];
+        jit_spill(&b);
+        if (inst->exec == chip8_op_fx33 || inst->exec == chip8_op_fx55) {
+            jit_invalidate(&b, inst->exec == chip8_op_fx33 ? 3 : inst->x + 1);
+        }
+        jit_exit(&b, pc + 2 * len);
+    }
+
+    // the budget can't run the whole block: it's given back, and chip8_run_block runs it bit by bit.
+    // add ebp, len
+    emit_patch(short_budget, b.p);
+    EMIT(&b.p, 0x83, 0xC5, len);
+    emit_set_pc(&b.p, pc);
+    emit_jmp(&b.p, jit->leave);
+
+    jit_protect(jit, jit->used, jit->used + (b.p - start), PROT_READ | PROT_EXEC);
+    jit->used += b.p - start;
+    jit->code[pc] = start;
+    jit->chain[pc] = chip8_idle_loop(chip8, pc) ? NULL : start;
+    jit->len[pc] = len;
+}
+
+struct Chip8Jit *chip8_jit_new(void) {
+    struct Chip8Jit *jit = calloc(1, sizeof(struct Chip8Jit));
+    if (!jit) {
+        fputs("Error: Could not allocate the JIT.", stderr);
+        exit(1);
+    }
+
+    jit->page = sysconf(_SC_PAGESIZE);
+    jit->arena = mmap(NULL, JIT_ARENASIZ, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (jit->arena == MAP_FAILED) {
+        free(jit);
+        return NULL;
+    }
+
+    uint8_t *p = jit->arena;
+    // push rbx; push rbp; push r12; push r13; push r14; push r15; sub rsp, 8 (keeping calls aligned)
+    // mov rbx, rdi; mov ebp, esi; jmp rdx
+    EMIT(&p, 0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57, 0x48, 0x83, 0xEC, 0x08);
+    EMIT(&p, 0x48, 0x89, 0xFB, 0x89, 0xF5, 0xFF, 0xE2);
+    jit->leave = p;
+    // mov eax, ebp; add rsp, 8; pop r15; pop r14; pop r13; pop r12; pop rbp; pop rbx; ret
+    EMIT(&p, 0x89, 0xE8, 0x48, 0x83, 0xC4, 0x08);
+    EMIT(&p, 0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B, 0xC3);
+    jit->stubs = jit->used = p - jit->arena;
+    jit_protect(jit, 0, jit->used, PROT_READ | PROT_EXEC);
+
+    // ISO C has no cast from data to function pointers
+    union {
+        uint8_t *data;
+        jit_enter code;
+    } enter = { .data = jit->arena };
+    jit->enter = enter.code;
+    return jit;
+}
+
+void chip8_jit_free(struct Chip8Jit *jit) {
+    if (jit) {
+        munmap(jit->arena, JIT_ARENASIZ);
+        free(jit);
+    }
+}
+
+int chip8_jit_run(struct Chip8Jit *jit, struct Chip8 *chip8, const struct Chip8Inst *block, uint8_t len, int budget) {
+    const uint16_t pc = chip8->pc;
+    if (!jit->code[pc] || jit->len[pc] != len) {
+        if (jit->heat[pc] < JIT_HOT) {
+            ++jit->heat[pc];
+            return 0;
+        }
+        jit_translate(jit, chip8, pc, block, len);
+    }
+
+    return budget - jit->enter(chip8, budget, jit->code[pc]);
+}
+
+void chip8_jit_invalidate(struct Chip8Jit *jit, uint16_t addr, uint16_t size) {
+    const int first = addr > 2 * BLOCKSIZ ? addr - 2 * BLOCKSIZ : 0;
+    const int end = addr + size < MEMORYSIZ ? addr + size : MEMORYSIZ;
+
+    for (int start = first; start < end; start++) {
+        if (start + 2 * jit->len[start] > addr) {
+            jit->code[start] = NULL;
+            jit->chain[start] = NULL;
+            jit->len[start] = 0;
+            jit->heat[start] = 0;
+        }
+    }
+}
+
+#else
+
+struct Chip8Jit *chip8_jit_new(void) {
+    return NULL;
+}
+
+void chip8_jit_free(struct Chip8Jit *jit) {
+    (void)jit;
+}
+
+int chip8_jit_run(struct Chip8Jit *jit, struct Chip8 *chip8, const struct Chip8Inst *block, uint8_t len, int budget) {
+    (void)jit;
+    (void)chip8;
+    (void)block;
+    (void)len;
+    (void)budget;
+    return 0;
+}
+
+void chip8_jit_invalidate(struct Chip8Jit *jit, uint16_t addr, uint16_t size) {
+    (void)jit;
+    (void)addr;
+    (void)size;
+}
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef CHIP8_JIT
+#define CHIP8_JIT
+#include "cpu.h"
+
+struct Chip8Jit;
+
+// returns NULL when the host isn't supported (only x86-64 is)
+struct Chip8Jit *chip8_jit_new(void);
+void chip8_jit_free(struct Chip8Jit *jit);
+
+// runs the native code of the `len` instructions of `block` starting at PC, and of the blocks
+// it goes straight on to, up to `budget` instructions (at least `len`). returns how many were run,
+// 0 if the block hasn't been run often enough to be worth translating yet
+int chip8_jit_run(struct Chip8Jit *jit, struct Chip8 *chip8, const struct Chip8Inst *block, uint8_t len, int budget);
+
+// drops the native code of every block that covers any of the `size` bytes starting at `addr`
+void chip8_jit_invalidate(struct Chip8Jit *jit, uint16_t addr, uint16_t size);
+#endif
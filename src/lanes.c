@@ -0,0 +1,498 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lanes.h"
+#include "opcode.h"
+
+// The lanes are operated on with the GCC/clang vector extensions, which are compiled
+// to AVX2 when it's enabled (e.g. -march=native) and to SSE2 (or NEON) otherwise.
+// Everything is kept in bytes, which every one of those handles natively.
+typedef uint8_t lanes_u8 __attribute__((vector_size(LANE_WIDTH)));
+typedef int8_t lanes_i8 __attribute__((vector_size(LANE_WIDTH)));
+
+static lanes_u8 load(const uint8_t *p) {
+    lanes_u8 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// only the lanes set in `m` are written
+static void store(uint8_t *p, lanes_u8 v, lanes_i8 m) {
+    v = (load(p) & ~(lanes_u8)m) | (v & (lanes_u8)m);
+    memcpy(p, &v, sizeof(v));
+}
+
+static lanes_u8 splat(uint8_t value) {
+    return (lanes_u8){0} + value;
+}
+
+static lanes_u8 lanes_min(lanes_u8 a, lanes_u8 b) {
+    const lanes_u8 lower = (lanes_u8)(a < b);
+    return (a & lower) | (b & ~lower);
+}
+
+static uint8_t lanes_reduce_min(lanes_u8 v) {
+    uint8_t min = 0xFF;
+    for (int i = 0; i < LANE_WIDTH; i++) {
+        min = v[i] < min ? v[i] : min;
+    }
+    return min;
+}
+
+static bool lanes_any(lanes_i8 m) {
+    uint64_t words[LANE_WIDTH / 8];
+    memcpy(words, &m, sizeof(m));
+    uint64_t any = 0;
+    for (size_t i = 0; i < LANE_WIDTH / 8; i++) {
+        any |= words[i];
+    }
+    return any;
+}
+
+// the instructions that are run on many lanes at once, everything else only touches
+// the state of its own lane (memory, video, the stack, keys) or is rare enough that
+// it's run lane by lane through its handler
+enum LanesKernel {
+    LANES_SCALAR,
+    LANES_1NNN,
+    LANES_3XKK,
+    LANES_4XKK,
+    LANES_5XY0,
+    LANES_9XY0,
+    LANES_6XKK,
+    LANES_7XKK,
+    LANES_8XY0,
+    LANES_8XY1,
+    LANES_8XY2,
+    LANES_8XY3,
+    LANES_8XY4,
+    LANES_8XY5,
+    LANES_8XY6,
+    LANES_8XY7,
+    LANES_8XYE,
+    LANES_ANNN,
+    LANES_FX07,
+    LANES_FX15,
+    LANES_FX18,
+    LANES_FX1E,
+    LANES_CXKK,
+};
+
+static const struct {
+    chip8_op exec;
+    enum LanesKernel kernel;
+} lanes_kernels[] = {
+    { chip8_op_1nnn, LANES_1NNN },
+    { chip8_op_3xkk, LANES_3XKK },
+    { chip8_op_4xkk, LANES_4XKK },
+    { chip8_op_5xy0, LANES_5XY0 },
+    { chip8_op_9xy0, LANES_9XY0 },
+    { chip8_op_6xkk, LANES_6XKK },
+    { chip8_op_7xkk, LANES_7XKK },
+    { chip8_op_8xy0, LANES_8XY0 },
+    { chip8_op_8xy1, LANES_8XY1 },
+    { chip8_op_8xy2, LANES_8XY2 },
+    { chip8_op_8xy3, LANES_8XY3 },
+    { chip8_op_8xy4, LANES_8XY4 },
+    { chip8_op_8xy5, LANES_8XY5 },
+    { chip8_op_8xy6, LANES_8XY6 },
+    { chip8_op_8xy7, LANES_8XY7 },
+    { chip8_op_8xye, LANES_8XYE },
+    { chip8_op_annn, LANES_ANNN },
+    { chip8_op_fx07, LANES_FX07 },
+    { chip8_op_fx15, LANES_FX15 },
+    { chip8_op_fx18, LANES_FX18 },
+    { chip8_op_fx1e, LANES_FX1E },
+    { chip8_op_cxkk, LANES_CXKK },
+};
+
+static enum LanesKernel lanes_kernel_of(const struct Chip8Inst *inst) {
+    for (size_t i = 0; i < sizeof(lanes_kernels) / sizeof(lanes_kernels[0]); i++) {
+        if (lanes_kernels[i].exec == inst->exec) {
+            return lanes_kernels[i].kernel;
+        }
+    }
+    return LANES_SCALAR;
+}
+
+#define REG(r) (lanes->registers[(r)] + o)
+
+// Runs `inst`, which is at `pc`, on the LANE_WIDTH lanes starting at `o` that are set in `m`.
+// The flags are computed in the same order as the handlers do, so that VF as an operand behaves the same.
+static void lanes_run_kernel(struct Chip8Lanes *lanes, const struct Chip8Inst *inst, enum LanesKernel kernel, uint16_t pc, int o, lanes_i8 m) {
+    const uint8_t x = inst->x;
+    const uint8_t y = inst->y;
+    const lanes_u8 vx = load(REG(x));
+    const lanes_u8 vy = load(REG(y));
+    lanes_i8 skip = {0};
+
+    switch (kernel) {
+        case LANES_3XKK:
+            skip = vx == inst->kk;
+        break;
+
+        case LANES_4XKK:
+            skip = vx != inst->kk;
+        break;
+
+        case LANES_5XY0:
+            skip = vx == vy;
+        break;
+
+        case LANES_9XY0:
+            skip = vx != vy;
+        break;
+
+        case LANES_6XKK:
+            store(REG(x), splat(inst->kk), m);
+        break;
+
+        case LANES_7XKK:
+            store(REG(x), vx + inst->kk, m);
+        break;
+
+        case LANES_8XY0:
+            store(REG(x), vy, m);
+        break;
+
+        case LANES_8XY1:
+            store(REG(x), vx | vy, m);
+        break;
+
+        case LANES_8XY2:
+            store(REG(x), vx & vy, m);
+        break;
+
+        case LANES_8XY3:
+            store(REG(x), vx ^ vy, m);
+        break;
+
+        case LANES_8XY4:
+            store(REG(x), vx + vy, m);
+            store(REG(VF), (lanes_u8)(vx + vy < vx) & 1, m);
+        break;
+
+        case LANES_8XY5:
+            store(REG(x), vx - vy, m);
+            store(REG(VF), (lanes_u8)(load(REG(x)) > load(REG(y))) & 1, m);
+        break;
+
+        case LANES_8XY6:
+            store(REG(x), vx >> 1, m);
+            store(REG(VF), load(REG(x)) & 1, m);
+        break;
+
+        case LANES_8XY7:
+            store(REG(x), vy - vx, m);
+            store(REG(VF), (lanes_u8)(load(REG(y)) > load(REG(x))) & 1, m);
+        break;
+
+        case LANES_8XYE:
+            store(REG(x), vx << 1, m);
+            store(REG(VF), load(REG(x)) & 1, m);
+        break;
+
+        case LANES_ANNN:
+            store(lanes->index_lo + o, splat(inst->nnn & 0xFF), m);
+            store(lanes->index_hi + o, splat(inst->nnn >> 8), m);
+        break;
+
+        case LANES_FX07:
+            store(REG(x), load(lanes->delay_timer + o), m);
+        break;
+
+        case LANES_FX15:
+            store(lanes->delay_timer + o, vx, m);
+        break;
+
+        case LANES_FX18:
+            store(lanes->sound_timer + o, vx, m);
+        break;
+
+        case LANES_FX1E: {
+            const lanes_u8 lo = load(lanes->index_lo + o);
+            // a true comparison is all ones, so the carry is added by subtracting it
+            store(lanes->index_hi + o, load(lanes->index_hi + o) - (lanes_u8)(lo + vx < lo), m);
+            store(lanes->index_lo + o, lo + vx, m);
+        }
+        break;
+
+        // every lane has its own generator, so the numbers are drawn one lane at a time
+        case LANES_CXKK:
+            for (int i = 0; i < LANE_WIDTH; i++) {
+                if (m[i]) {
+                    REG(x)[i] = chip8_random_next(&lanes->rng[o + i]) & inst->kk;
+                }
+            }
+        break;
+
+        case LANES_1NNN:
+        case LANES_SCALAR:
+        break;
+    }
+
+    // every lane of the group goes to one of two places: the target, or past it when skipping
+    const uint16_t target = MEMORY_ADDR(kernel == LANES_1NNN ? inst->nnn : pc + 2);
+    const uint16_t flip = target ^ MEMORY_ADDR(target + 2);
+    const lanes_u8 s = (lanes_u8)skip;
+    store(lanes->pc_lo + o, splat(target & 0xFF) ^ (s & splat(flip & 0xFF)), m);
+    store(lanes->pc_hi + o, splat(target >> 8) ^ (s & splat(flip >> 8)), m);
+    // and adding the all ones of the mask takes 1 off
+    store(lanes->left + o, load(lanes->left + o) + (lanes_u8)m, m);
+}
+
+static void *lanes_alloc(size_t size) {
+    void *p = calloc(1, size);
+    if (!p) {
+        fputs("Error: Could not allocate the lanes.", stderr);
+        exit(1);
+    }
+    return p;
+}
+
+struct Chip8Lanes *chip8_lanes_new(int count) {
+    struct Chip8Lanes *lanes = lanes_alloc(sizeof(struct Chip8Lanes));
+    lanes->count = count;
+    lanes->stride = (count + LANE_WIDTH - 1) / LANE_WIDTH * LANE_WIDTH;
+
+    lanes->machines = lanes_alloc(count * sizeof(struct Chip8));
+    for (int r = 0; r < REGISTERSIZ; r++) {
+        lanes->registers[r] = lanes_alloc(lanes->stride);
+    }
+    lanes->pc_lo = lanes_alloc(lanes->stride);
+    lanes->pc_hi = lanes_alloc(lanes->stride);
+    lanes->index_lo = lanes_alloc(lanes->stride);
+    lanes->index_hi = lanes_alloc(lanes->stride);
+    lanes->delay_timer = lanes_alloc(lanes->stride);
+    lanes->sound_timer = lanes_alloc(lanes->stride);
+    lanes->rng = lanes_alloc(lanes->stride * sizeof(uint32_t));
+    lanes->left = lanes_alloc(lanes->stride);
+    lanes->mask = lanes_alloc(lanes->stride);
+
+    const struct Chip8 chip8 = chip8_new();
+    for (int i = 0; i < count; i++) {
+        chip8_lanes_set(lanes, i, &chip8);
+    }
+    return lanes;
+}
+
+void chip8_lanes_free(struct Chip8Lanes *lanes) {
+    if (!lanes) {
+        return;
+    }
+    for (int r = 0; r < REGISTERSIZ; r++) {
+        free(lanes->registers[r]);
+    }
+    free(lanes->pc_lo);
+    free(lanes->pc_hi);
+    free(lanes->index_lo);
+    free(lanes->index_hi);
+    free(lanes->delay_timer);
+    free(lanes->sound_timer);
+    free(lanes->rng);
+    free(lanes->left);
+    free(lanes->mask);
+    free(lanes->machines);
+    free(lanes);
+}
+
+void chip8_lanes_load_rom(struct Chip8Lanes *lanes, const char *restrict filename) {
+    chip8_load_rom(&lanes->machines[0], filename);
+    for (int i = 1; i < lanes->count; i++) {
+        memcpy(lanes->machines[i].memory, lanes->machines[0].memory, MEMORYSIZ);
+    }
+    memset(lanes->written, 0, sizeof(lanes->written));
+}
+
+// every register
+#define LANES_REGS 0xFFFF
+
+// copies the registers in the bitmask `regs`, and everything else the lanes keep to themselves, into the machine of `lane`
+static struct Chip8 *lanes_get(struct Chip8Lanes *lanes, int lane, uint16_t regs) {
+    struct Chip8 *chip8 = &lanes->machines[lane];
+    for (int r = V0; r <= VF; r++) {
+        if (regs & 1u << r) {
+            chip8->registers[r] = lanes->registers[r][lane];
+        }
+    }
+    chip8->pc = lanes->pc_hi[lane] << 8 | lanes->pc_lo[lane];
+    chip8->index = lanes->index_hi[lane] << 8 | lanes->index_lo[lane];
+    chip8->delay_timer = lanes->delay_timer[lane];
+    chip8->sound_timer = lanes->sound_timer[lane];
+    chip8->rng = lanes->rng[lane];
+    return chip8;
+}
+
+// and back out of it
+static void lanes_put(struct Chip8Lanes *lanes, int lane, uint16_t regs) {
+    const struct Chip8 *chip8 = &lanes->machines[lane];
+    for (int r = V0; r <= VF; r++) {
+        if (regs & 1u << r) {
+            lanes->registers[r][lane] = chip8->registers[r];
+        }
+    }
+    const uint16_t pc = MEMORY_ADDR(chip8->pc);
+    lanes->pc_lo[lane] = pc & 0xFF;
+    lanes->pc_hi[lane] = pc >> 8;
+    lanes->index_lo[lane] = chip8->index & 0xFF;
+    lanes->index_hi[lane] = chip8->index >> 8;
+    lanes->delay_timer[lane] = chip8->delay_timer;
+    lanes->sound_timer[lane] = chip8->sound_timer;
+    lanes->rng[lane] = chip8->rng;
+}
+
+struct Chip8 *chip8_lanes_get(struct Chip8Lanes *lanes, int lane) {
+    return lanes_get(lanes, lane, LANES_REGS);
+}
+
+void chip8_lanes_set(struct Chip8Lanes *lanes, int lane, const struct Chip8 *chip8) {
+    struct Chip8 *machine = &lanes->machines[lane];
+    // every address that wasn't written yet holds the same in all lanes, until now
+    for (int addr = 0; addr < MEMORYSIZ; addr++) {
+        lanes->written[addr] |= machine->memory[addr] != chip8->memory[addr];
+    }
+
+    *machine = *chip8;
+    machine->cache = NULL;
+    machine->jit = NULL;
+    machine->trace = NULL;
+#ifdef CHIP8_PROFILER
+    machine->profile = NULL;
+#endif
+    lanes_put(lanes, lane, LANES_REGS);
+}
+
+// Runs an instruction on a single lane, through its handler. Only the registers it
+// uses are copied in and out: Vx, Vy and VF, or all of them for the few that use more.
+static void lanes_run_one(struct Chip8Lanes *lanes, int lane, const struct Chip8Inst *inst) {
+    const bool all = inst->exec == chip8_op_fx55 || inst->exec == chip8_op_fx65 || inst->exec == chip8_op_bnnn;
+    const uint16_t regs = all ? LANES_REGS : 1u << inst->x | 1u << inst->y | 1u << VF;
+    struct Chip8 *chip8 = lanes_get(lanes, lane, regs);
+
+    const uint16_t index = chip8->index;
+    chip8->pc += 2;
+    inst->exec(chip8, inst);
+
+    lanes_put(lanes, lane, regs);
+    --lanes->left[lane];
+    // Fx0A halted it, it runs nothing more until its key is released
+    if (CHIP8_HALTED(chip8)) {
+        lanes->halted += lanes->left[lane];
+        lanes->left[lane] = 0;
+    }
+
+    // Fx33 writes 3 bytes, Fx55 writes V0 through Vx
+    if (inst->flags & CHIP8_INST_WRITE) {
+        const int size = inst->exec == chip8_op_fx33 ? 3 : inst->x + 1;
+        for (int i = 0; i < size; i++) {
+            lanes->written[MEMORY_ADDR(index + i)] = true;
+        }
+    }
+}
+
+// The lowest PC of the lanes that still have instructions to run, 0xFFFF if there are none.
+// Running the lanes that are behind first lets the ones that skipped ahead be caught up with.
+// The high bytes are narrowed down first, and then the low bytes of the lanes that have the lowest one.
+static uint16_t lanes_lowest_pc(const struct Chip8Lanes *lanes) {
+    lanes_u8 lowest = splat(0xFF);
+    for (int o = 0; o < lanes->stride; o += LANE_WIDTH) {
+        lowest = lanes_min(lowest, load(lanes->pc_hi + o) | (lanes_u8)(load(lanes->left + o) == 0));
+    }
+    const uint8_t hi = lanes_reduce_min(lowest);
+    // PCs are only 12 bits, so no lane that is left has 0xFF as its high byte
+    if (hi == 0xFF) {
+        return 0xFFFF;
+    }
+
+    lowest = splat(0xFF);
+    for (int o = 0; o < lanes->stride; o += LANE_WIDTH) {
+        const lanes_i8 live = (load(lanes->pc_hi + o) == splat(hi)) & (load(lanes->left + o) != 0);
+        lowest = lanes_min(lowest, load(lanes->pc_lo + o) | ~(lanes_u8)live);
+    }
+    return hi << 8 | lanes_reduce_min(lowest);
+}
+
+// Runs the instruction at `pc` on every lane that is there and still has instructions
+// to run. Lanes that wrote to the code at `pc` might be at a different instruction,
+// those are left for a later group.
+static void lanes_run_group(struct Chip8Lanes *lanes, uint16_t pc) {
+    const uint16_t next = MEMORY_ADDR(pc + 1);
+    const bool written = lanes->written[pc] || lanes->written[next];
+    uint16_t opcode = (lanes->machines[0].memory[pc] << 8) | lanes->machines[0].memory[next];
+    if (written) {
+        int first = -1;
+        for (int i = 0; i < lanes->stride; i++) {
+            const bool here = i < lanes->count && lanes->left[i] && (lanes->pc_hi[i] << 8 | lanes->pc_lo[i]) == pc;
+            lanes->mask[i] = here ? -1 : 0;
+            if (!here) {
+                continue;
+            }
+            const uint8_t *memory = lanes->machines[i].memory;
+            const uint16_t own = (memory[pc] << 8) | memory[next];
+            if (first < 0) {
+                first = i;
+                opcode = own;
+            } else if (own != opcode) {
+                lanes->mask[i] = 0;
+            }
+        }
+    }
+
+    const struct Chip8Inst inst = chip8_decode(opcode);
+    const enum LanesKernel kernel = lanes_kernel_of(&inst);
+
+    for (int o = 0; o < lanes->stride; o += LANE_WIDTH) {
+        lanes_i8 m;
+        if (written) {
+            memcpy(&m, lanes->mask + o, sizeof(m));
+        } else {
+            m = (load(lanes->pc_lo + o) == splat(pc & 0xFF)) & (load(lanes->pc_hi + o) == splat(pc >> 8)) & (load(lanes->left + o) != 0);
+        }
+        if (!lanes_any(m)) {
+            continue;
+        }
+
+        if (kernel != LANES_SCALAR) {
+            lanes_run_kernel(lanes, &inst, kernel, pc, o, m);
+            continue;
+        }
+        for (int i = 0; i < LANE_WIDTH; i++) {
+            if (m[i]) {
+                lanes_run_one(lanes, o + i, &inst);
+            }
+        }
+    }
+}
+
+// the most instructions run on the lanes in one go, so that what's left of them fits in a byte
+#define LANES_RUNSIZ 255
+
+long chip8_lanes_run_frame(struct Chip8Lanes *lanes, int ipf) {
+    lanes->halted = 0;
+    for (int done = 0; done < ipf; done += LANES_RUNSIZ) {
+        const int run = ipf - done < LANES_RUNSIZ ? ipf - done : LANES_RUNSIZ;
+        memset(lanes->left, run, lanes->count);
+        for (int i = 0; i < lanes->count; i++) {
+            if (CHIP8_HALTED(&lanes->machines[i])) {
+                lanes->halted += run;
+                lanes->left[i] = 0;
+            }
+        }
+
+        for (uint16_t pc; (pc = lanes_lowest_pc(lanes)) != 0xFFFF;) {
+            lanes_run_group(lanes, pc);
+        }
+    }
+
+    for (int o = 0; o < lanes->stride; o += LANE_WIDTH) {
+        lanes_u8 delay = load(lanes->delay_timer + o);
+        lanes_u8 sound = load(lanes->sound_timer + o);
+        // adding the all ones of a true comparison takes 1 off
+        delay += (lanes_u8)(delay != 0);
+        sound += (lanes_u8)(sound != 0);
+        memcpy(lanes->delay_timer + o, &delay, sizeof(delay));
+        memcpy(lanes->sound_timer + o, &sound, sizeof(sound));
+    }
+
+    return (long)ipf * lanes->count - lanes->halted;
+}
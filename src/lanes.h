@@ -0,0 +1,59 @@
+#ifndef CHIP8_LANES
+#define CHIP8_LANES
+#include "cpu.h"
+
+// lanes handled by a single vector operation (a whole vector register), the lane count is rounded up to a multiple of it
+#ifdef __AVX2__
+#define LANE_WIDTH 32
+#else
+#define LANE_WIDTH 16
+#endif
+
+// Many copies of the same program run in lockstep, one per lane. The state every
+// instruction touches (registers, PC, I and timers) is stored as one array per field
+// with an entry per lane, so an instruction that several lanes are at is run for all
+// of them at once with vector operations. Lanes whose control flow went elsewhere are
+// run as their own group, and lanes at the same PC join up again.
+struct Chip8Lanes {
+    int count;
+    // entries in each of the arrays below
+    int stride;
+    // memory, stack, keypad and video of every lane. their registers, PC, I, timers
+    // and RNG are only up to date after chip8_lanes_get
+    struct Chip8 *machines;
+    // registers[r][lane]
+    uint8_t *registers[REGISTERSIZ];
+    // PC and I are split into their low and high bytes, so every operation on the lanes works on bytes
+    uint8_t *pc_lo;
+    uint8_t *pc_hi;
+    uint8_t *index_lo;
+    uint8_t *index_hi;
+    uint8_t *delay_timer;
+    uint8_t *sound_timer;
+    uint32_t *rng;
+    // instructions every lane still has to run in the current frame (or the part of it that is run)
+    uint8_t *left;
+    // the lanes the current group is run on, -1 or 0 for every lane
+    int8_t *mask;
+    // instructions that lanes halted by Fx0A didn't run in the current frame
+    long halted;
+    // addresses that some lane wrote to since the program was loaded,
+    // where lanes can't be assumed to be at the same instruction anymore just by their PC
+    bool written[MEMORYSIZ];
+};
+
+struct Chip8Lanes *chip8_lanes_new(int count);
+void chip8_lanes_free(struct Chip8Lanes *lanes);
+
+// loads the same ROM into every lane
+void chip8_lanes_load_rom(struct Chip8Lanes *lanes, const char *restrict filename);
+
+// brings the machine of `lane` up to date and returns it
+struct Chip8 *chip8_lanes_get(struct Chip8Lanes *lanes, int lane);
+// replaces the whole state of `lane`
+void chip8_lanes_set(struct Chip8Lanes *lanes, int lane, const struct Chip8 *chip8);
+
+// runs a frame on every lane: `ipf` instructions each and then a timer tick,
+// returns the instructions run across all of them
+long chip8_lanes_run_frame(struct Chip8Lanes *lanes, int ipf);
+#endif
@@ -1,347 +1,663 @@
 #include <stdio.h>
-#include "SDL_thread.h"
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
 #include "cpu.h"
 #include "io.h"
+#include "cache.h"
+#include "jit.h"
+#include "frame.h"
+#include "state.h"
+#include "rewind.h"
+#include "movie.h"
+#include "profile.h"
 
 void test_instructions(struct Chip8 *chip8);
 
+// instructions run in every 60hz frame
+static int ipf = IPF;
+
+// finished frames, going from the emulation thread to the render loop
+static struct Chip8Frames frames;
+
+// key presses and releases, going from the render loop to the emulation thread
+static struct Chip8Input input;
+// the rewind key is held down, so the emulation goes back a frame every frame instead of running one
+static bool rewinding = false;
+
+// whether the tone sounds in every frame, going from the emulation thread to the audio device
+static struct Chip8Audio audio;
+// samples in every buffer of the audio device, the fewer the sooner the tone is heard
+static int audio_samples = 512;
+
+// the frames that can be gone back to, NULL when rewinding is off
+static struct Chip8Rewind *history = NULL;
+// the most memory the history takes up
+#define REWIND_BYTES (16 * 1024 * 1024)
+
+// every key going down or up is recorded into `movie` when there's a file to save it to
+static const char *movie_file = NULL;
+static struct Chip8Movie movie;
+// frames run since the start, less the ones gone back
+static long long frames_run = 0;
+// the keys held down on the keyboard right now
+static bool held[KEYPADSIZ];
+
+// presses or releases a key on the machine, right before the frame that runs next
+static void press_key(struct Chip8 *chip8, uint8_t key, bool down) {
+    if (movie_file) {
+        chip8_movie_key(&movie, frames_run, chip8, key, down);
+    } else {
+        chip8_key(chip8, key, down);
+    }
+}
+
+// applies the input queued since the last frame, in the order it happened
+static void apply_input(struct Chip8 *chip8) {
+    struct Chip8InputEvent event;
+    while (chip8_input_pop(&input, &event)) {
+        if (event.key == CHIP8_INPUT_REWIND) {
+            rewinding = event.down;
+        } else {
+            held[event.key % KEYPADSIZ] = event.down;
+            press_key(chip8, event.key, event.down);
+        }
+    }
+}
+
+// Runs the emulation a frame at a time: the input that came in, a batch of instructions and a timer tick,
+// then hands the screen to the render loop and the tone to the audio device, and then sleeps until the next frame is due.
 int run_chip8_subsystems(void *data) {
     struct Chip8 *chip8 = data;
+    const uint64_t freq = SDL_GetPerformanceFrequency();
+    const uint64_t frame = freq / FRAMERATE;
+    uint64_t deadline = SDL_GetPerformanceCounter();
+
     while (running) {
-        chip8_cycle(chip8);
-        chip8_capture_input(chip8);
-        chip8_play_audio(chip8);
+        apply_input(chip8);
+        if (history && rewinding) {
+            if (chip8_rewind_step(history, chip8)) {
+                frames_run--;
+                if (movie_file) {
+                    chip8_movie_cut(&movie, frames_run);
+                }
+            }
+        } else {
+            // going back brought back the keys of the frame gone back to, the ones held down now take over again
+            for (int k = 0; k < KEYPADSIZ; k++) {
+                if (chip8->keypad[k] != held[k]) {
+                    press_key(chip8, k, held[k]);
+                }
+            }
+            if (movie_file) {
+                chip8_movie_record(&movie, frames_run);
+            }
+            chip8_run_frame(chip8, ipf);
+            frames_run++;
+            if (history) {
+                chip8_rewind_record(history, chip8);
+            }
+        }
+        chip8_frames_publish(&frames, chip8);
+        chip8_audio_frame(&audio, chip8);
+
+        // deadlines are kept on a fixed grid so sleeping too long doesn't add up,
+        // unless we fell so far behind (e.g. the host was suspended) that catching up makes no sense
+        deadline += frame;
+        uint64_t now = SDL_GetPerformanceCounter();
+        if (now > deadline + frame * 5) {
+            deadline = now;
+        }
+        if (now < deadline) {
+            SDL_Delay((deadline - now) * 1000 / freq);
+        }
     }
     return 0;
 }
 
 int main(int argc, char **argv) {
-    if (argc == 1) {
+    const char *rom = NULL;
+    bool use_jit = false;
+    int rewind_seconds = 600;
+    uint64_t seed = 0;
+    struct Chip8VideoOptions video = {
+        .fg = 0xFFFFFFFF,
+        .bg = 0xFF000000,
+        .smooth = false,
+    };
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0) {
+            use_jit = true;
+        } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            ipf = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            // RRGGBB,RRGGBB
+            char *bg;
+            video.fg = 0xFF000000 | strtoul(argv[++i], &bg, 16);
+            video.bg = 0xFF000000 | strtoul(*bg == ',' ? bg + 1 : bg, NULL, 16);
+        } else if (strcmp(argv[i], "-s") == 0) {
+            video.smooth = true;
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            rewind_seconds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+            audio_samples = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-S") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            movie_file = argv[++i];
+        } else {
+            rom = argv[i];
+        }
+    }
+
+    if (!rom) {
         fputs("Error: No ROM was supplied.", stderr);
         return 0;
     }
 
+    if (ipf <= 0) {
+        fputs("Error: The instructions per frame must be a positive number.", stderr);
+        return 1;
+    }
+
+    if (audio_samples <= 0 || (audio_samples & (audio_samples - 1))) {
+        fputs("Error: The audio buffer must be a power of 2 samples.", stderr);
+        return 1;
+    }
+
     struct Chip8 chip8 = chip8_new();
-    chip8_load_rom(&chip8, argv[1]);
+    chip8_load_rom(&chip8, rom);
 
     #ifndef NDEBUG
     test_instructions(&chip8);
     // resets chip8 state after running tests
     chip8 = chip8_new();
-    chip8_load_rom(&chip8, argv[1]);
+    chip8_load_rom(&chip8, rom);
     #endif
+    chip8_seed(&chip8, seed);
+    movie = chip8_movie_new(seed, ipf);
+    chip8.cache = chip8_cache_new();
+#ifdef CHIP8_PROFILER
+    chip8.profile = chip8_profile_new();
+#endif
+    if (use_jit) {
+        chip8.jit = chip8_jit_new();
+        if (!chip8.jit) {
+            fputs("Warning: The JIT isn't supported on this host, interpreting instead.", stderr);
+        }
+    }
+
+    if (rewind_seconds > 0) {
+        history = chip8_rewind_new(rewind_seconds * FRAMERATE, REWIND_BYTES);
+    }
 
-    chip8_init_video(&chip8);
-    chip8_init_input(&chip8);
-    chip8_init_audio(&chip8);
+    chip8_init_video(&video);
+    chip8_init_input(&input);
+    chip8_init_audio(&audio, audio_samples);
 
-   SDL_Thread *sub_thread = SDL_CreateThread(run_chip8_subsystems, "run_chip8_subsystems", &chip8);
+    chip8_frames_init(&frames);
+    SDL_Thread *sub_thread = SDL_CreateThread(run_chip8_subsystems, "run_chip8_subsystems", &chip8);
 
     while (running) {
-        chip8_video_draw(&chip8);
+        chip8_capture_input(&input);
+        chip8_video_draw(chip8_frames_take(&frames));
     }
 
     SDL_WaitThread(sub_thread, NULL);
     chip8_quit_audio();
     chip8_quit_video();
+    if (movie_file) {
+        chip8_movie_save(&movie, movie_file);
+    }
+    chip8_movie_free(&movie);
+    chip8_rewind_free(history);
+#ifdef CHIP8_PROFILER
+    chip8_profile_report(chip8.profile, &chip8, CHIP8_PROFILE_TOP, stderr);
+    chip8_profile_free(chip8.profile);
+#endif
+    chip8_jit_free(chip8.jit);
+    chip8_cache_free(chip8.cache);
     return 0;
 }
 
 #ifndef NDEBUG
 #include <assert.h>
 #include "opcode.h"
+
+// decodes `inst` and runs it through `op`, like chip8_cycle would
+static void run_op(struct Chip8 *chip8, chip8_op op, uint16_t inst) {
+    const struct Chip8Inst decoded = chip8_decode(inst);
+    op(chip8, &decoded);
+}
+
 void test_instructions(struct Chip8 *chip8) {
+    uint16_t inst;
     int sp;
     int pc;
     // CLS
-    memset(chip8->video, 0xFFFFFFFF, sizeof(chip8->video));
-    assert(chip8->video[0] == 0xFFFFFFFF);
-    chip8->inst = 0x00E0;
-    chip8_op_00e0(chip8);
-    assert(chip8->video[0] == 0);
+    memset(chip8->video, 0xFF, sizeof(chip8->video));
+    chip8->video_hash = chip8_video_hash(chip8->video);
+    assert(VIDEO_PIXEL(chip8->video, 0, 0));
+    inst = 0x00E0;
+    run_op(chip8, chip8_op_00e0, inst);
+    assert(!VIDEO_PIXEL(chip8->video, 0, 0));
+    assert(chip8->video_hash == chip8_new().video_hash);
 
     // RET 
+    inst = 0x00EE;
     chip8->sp = 1;
     chip8->stack[1] = 0x200;
-    chip8_op_00ee(chip8);
+    run_op(chip8, chip8_op_00ee, inst);
     assert(chip8->pc == 0x200);
     assert(chip8->sp == 0);
 
     // JP addr
-    chip8->inst = 0x1234;
-    chip8_op_1nnn(chip8);
+    inst = 0x1234;
+    run_op(chip8, chip8_op_1nnn, inst);
     assert(chip8->pc == 0x234);
 
     // CALL addr
-    chip8->inst = 0x2555;
+    inst = 0x2555;
     sp = chip8->sp;
-    chip8_op_2nnn(chip8);
+    run_op(chip8, chip8_op_2nnn, inst);
     assert(chip8->sp == sp + 1);
     assert(chip8->pc == 0x555);
 
     // SE Vx, byte
     pc = chip8->pc;
     chip8->registers[V2] = 0x89;
-    chip8->inst = 0x3289;
-    chip8_op_3xkk(chip8);
+    inst = 0x3289;
+    run_op(chip8, chip8_op_3xkk, inst);
     assert(chip8->pc == pc + 2);
 
     pc = chip8->pc;
-    chip8->inst = 0x3211;
-    chip8_op_3xkk(chip8);
+    inst = 0x3211;
+    run_op(chip8, chip8_op_3xkk, inst);
     assert(chip8->pc == pc);
 
     // SNE Vx, byte
     pc = chip8->pc;
     chip8->registers[V3] = 0x80;
-    chip8->inst = 0x4320;
-    chip8_op_4xkk(chip8);
+    inst = 0x4320;
+    run_op(chip8, chip8_op_4xkk, inst);
     assert(chip8->pc == pc + 2);
 
     pc = chip8->pc;
-    chip8->inst = 0x4380;
-    chip8_op_4xkk(chip8);
+    inst = 0x4380;
+    run_op(chip8, chip8_op_4xkk, inst);
     assert(chip8->pc == pc);
 
     // SE Vx, Vy
     pc = chip8->pc;
     chip8->registers[V2] = 0x89;
     chip8->registers[VA] = 0x89;
-    chip8->inst = 0x52A0;
-    chip8_op_5xy0(chip8);
+    inst = 0x52A0;
+    run_op(chip8, chip8_op_5xy0, inst);
     assert(chip8->pc == pc + 2);
 
     pc = chip8->pc;
     chip8->registers[V2] = 0x89;
     chip8->registers[VA] = 0x20;
-    chip8->inst = 0x52A0;
-    chip8_op_5xy0(chip8);
+    inst = 0x52A0;
+    run_op(chip8, chip8_op_5xy0, inst);
     assert(chip8->pc == pc);
 
     // LD Vx, byte
-    chip8->inst = 0x6D99;
-    chip8_op_6xkk(chip8);
+    inst = 0x6D99;
+    run_op(chip8, chip8_op_6xkk, inst);
     assert(chip8->registers[VD] == 0x99);
 
     // ADD Vx, byte
-    chip8->inst = 0x7110;
+    inst = 0x7110;
     chip8->registers[V1] = 0x10;
-    chip8_op_7xkk(chip8);
+    run_op(chip8, chip8_op_7xkk, inst);
     assert(chip8->registers[V1] == 0x20);
 
     // LD Vx, Vy
     chip8->registers[VC] = 0x66;
-    chip8->inst = 0x87C0;
-    chip8_op_8xy0(chip8);
+    inst = 0x87C0;
+    run_op(chip8, chip8_op_8xy0, inst);
     assert(chip8->registers[7] == 0x66);
 
     // OR Vx, Vy
-    chip8->inst = 0x8EA1;
+    inst = 0x8EA1;
     chip8->registers[VE] = 0b10101010;
     chip8->registers[VA] = 0b01010101;
-    chip8_op_8xy1(chip8);
+    run_op(chip8, chip8_op_8xy1, inst);
     assert(chip8->registers[VE] == 0b11111111);
 
     // AND Vx, Vy 
-    chip8->inst = 0x8562;
+    inst = 0x8562;
     chip8->registers[V5] = 0xAF;
     chip8->registers[V6] =  0xF0;
-    chip8_op_8xy2(chip8);
+    run_op(chip8, chip8_op_8xy2, inst);
     assert(chip8->registers[V5] == 0xA0);
 
     // XOR Vx, Vy
-    chip8->inst = 0x8343;
+    inst = 0x8343;
     chip8->registers[V3] = 0b11110010;
     chip8->registers[V4] = 0b11001101;
-    chip8_op_8xy3(chip8);
+    run_op(chip8, chip8_op_8xy3, inst);
     assert(chip8->registers[V3] = 0b00111111);
 
 
     // ADD Vx, Vy
-    chip8->inst = 0x8CD4;
+    inst = 0x8CD4;
     chip8->registers[VC] = 100;
     chip8->registers[VD] = 150;
-    chip8_op_8xy4(chip8);
+    run_op(chip8, chip8_op_8xy4, inst);
     assert(chip8->registers[VC] == 250);
     
     // SUB Vx, Vy
-    chip8->inst = 0x8AB5;
+    inst = 0x8AB5;
     chip8->registers[VA] = 0x80;
     chip8->registers[VB] = 0x75;
-    chip8_op_8xy5(chip8);
+    run_op(chip8, chip8_op_8xy5, inst);
     assert(chip8->registers[VA] == 0xB);
     
     // SHR Vx, {, Vy}
-    chip8->inst = 0x8006;
+    inst = 0x8006;
     chip8->registers[V0] = 0xFF;
-    chip8_op_8xy6(chip8);
+    run_op(chip8, chip8_op_8xy6, inst);
     assert(chip8->registers[V0] == 0x7F);
 
     // SUBN Vx, Vy
-    chip8->inst = 0x8127;
+    inst = 0x8127;
     chip8->registers[V1] = 2;
     chip8->registers[V2] = 4;
-    chip8_op_8xy7(chip8);
+    run_op(chip8, chip8_op_8xy7, inst);
     assert(chip8->registers[VF] == 1);
     assert(chip8->registers[V1] == 2);
 
     chip8->registers[V1] = 4;
     chip8->registers[V2] = 2;
-    chip8_op_8xy7(chip8);
+    run_op(chip8, chip8_op_8xy7, inst);
     assert(chip8->registers[VF] == 0);
     assert(chip8->registers[V1] == 254);
 
     // SHL Vx {, Vy}
-    chip8->inst = 0x890e;
+    inst = 0x890e;
     chip8->registers[V9] = 0xFF;
-    chip8_op_8xye(chip8);
+    run_op(chip8, chip8_op_8xye, inst);
     assert(chip8->registers[V9] == 0b11111110);
 
     // SNE Vx, Vy
     pc = chip8->pc;
     chip8->registers[V3] = 0x80;
     chip8->registers[V4] = 0x81;
-    chip8->inst = 0x9340;
-    chip8_op_9xy0(chip8);
+    inst = 0x9340;
+    run_op(chip8, chip8_op_9xy0, inst);
     assert(chip8->pc == pc + 2);
 
     pc = chip8->pc;
     chip8->registers[V3] = 0x80;
     chip8->registers[V4] = 0x80;
-    chip8->inst = 0x9340;
-    chip8_op_9xy0(chip8);
+    inst = 0x9340;
+    run_op(chip8, chip8_op_9xy0, inst);
     assert(chip8->pc == pc);
 
     // LD I, addr
-    chip8->inst = 0xA999;
-    chip8_op_annn(chip8);
+    inst = 0xA999;
+    run_op(chip8, chip8_op_annn, inst);
     assert(chip8->index == 0x999);
     
     // JP V0, addr
     chip8->registers[V0] = 0x88;
-    chip8->inst = 0xB080;
-    chip8_op_bnnn(chip8);
+    inst = 0xB080;
+    run_op(chip8, chip8_op_bnnn, inst);
     assert(chip8->pc == 0x108);
 
     // RND Vx, byte
-    chip8->inst = 0xCAFF;
-    chip8_op_cxkk(chip8);
+    inst = 0xCAFF;
+    run_op(chip8, chip8_op_cxkk, inst);
     int rnd = chip8->registers[VA];
-    chip8_op_cxkk(chip8);
+    run_op(chip8, chip8_op_cxkk, inst);
     assert(rnd != chip8->registers[VA]);
     assert(rnd >= 0 && rnd < 256);
+    // the same seed draws the same numbers
+    chip8_seed(chip8, 1234);
+    run_op(chip8, chip8_op_cxkk, inst);
+    rnd = chip8->registers[VA];
+    chip8_seed(chip8, 1234);
+    run_op(chip8, chip8_op_cxkk, inst);
+    assert(rnd == chip8->registers[VA]);
+    chip8_seed(chip8, 0);
+    assert(chip8->rng != 0);
 
     // DRW Vx, Vy, nibble
     chip8->registers[V2] = 2;
     chip8->registers[V3] = 2;
-    chip8->inst = 0xD232;
+    inst = 0xD232;
     chip8->index = 0;
     chip8->memory[0] = 0xFF;
     chip8->memory[1] = 0x0F;
-    chip8_op_dxyn(chip8);
+    chip8->dirty_rows = 0;
+    run_op(chip8, chip8_op_dxyn, inst);
+    assert(chip8->dirty_rows == (1u << 2 | 1u << 3));
     for (size_t i = 0; i < 8; i++) {
-        assert(chip8->video[2 * VIDEO_W + (i + 2)] == 0xFFFFFFFF);
+        assert(VIDEO_PIXEL(chip8->video, i + 2, 2));
     }
     for (size_t i = 0; i < 4; i++) {
-        assert(chip8->video[3 * VIDEO_W + (i + 2)] == 0);
+        assert(!VIDEO_PIXEL(chip8->video, i + 2, 3));
     }
     for (size_t i = 4; i < 8; i++) {
-        assert(chip8->video[3 * VIDEO_W + (i + 2)] == 0xFFFFFFFF);
+        assert(VIDEO_PIXEL(chip8->video, i + 2, 3));
     }
+    assert(chip8->registers[VF] == 0);
+    // the hash follows what was drawn
+    assert(chip8->video_hash == chip8_video_hash(chip8->video));
+    assert(chip8->video_hash != chip8_new().video_hash);
+
+    // drawing it again erases it
+    run_op(chip8, chip8_op_dxyn, inst);
+    assert(chip8->registers[VF] == 1);
+    assert(!VIDEO_PIXEL(chip8->video, 2, 2));
+    assert(chip8->video_hash == chip8_new().video_hash);
+
+    // sprites wrap around the right edge
+    chip8->registers[V2] = VIDEO_W - 4;
+    run_op(chip8, chip8_op_dxyn, inst);
+    assert(VIDEO_PIXEL(chip8->video, VIDEO_W - 1, 2));
+    assert(VIDEO_PIXEL(chip8->video, 3, 2));
+    assert(!VIDEO_PIXEL(chip8->video, 4, 2));
+    run_op(chip8, chip8_op_dxyn, inst);
     
     // SKP Vx
     chip8->keypad[5] = 1;
     chip8->registers[V1] = 5;
-    chip8->inst = 0xE19E;
+    inst = 0xE19E;
     pc = chip8->pc;
-    chip8_op_ex9e(chip8);
+    run_op(chip8, chip8_op_ex9e, inst);
     assert(chip8->pc == pc + 2);
 
     chip8->keypad[5] = 0;
     pc = chip8->pc;
-    chip8_op_ex9e(chip8);
+    run_op(chip8, chip8_op_ex9e, inst);
     assert(chip8->pc == pc);
     
     // SKNP Vx
     chip8->keypad[5] = 0;
     chip8->registers[V1] = 5;
-    chip8->inst = 0xE19E;
+    inst = 0xE19E;
     pc = chip8->pc;
-    chip8_op_exa1(chip8);
+    run_op(chip8, chip8_op_exa1, inst);
     assert(chip8->pc == pc + 2);
 
     chip8->keypad[5] = 1;
     pc = chip8->pc;
-    chip8_op_exa1(chip8);
+    run_op(chip8, chip8_op_exa1, inst);
     assert(chip8->pc == pc);
     chip8->keypad[5] = 0;
 
     // LD Vx, DT
-    chip8->inst = 0xF207;
+    inst = 0xF207;
     chip8->delay_timer = 255;
-    chip8_op_fx07(chip8);
+    run_op(chip8, chip8_op_fx07, inst);
     assert(chip8->registers[V2] == 255);
 
     // LD Vx, K
-    chip8->inst = 0xF80A;
-    chip8->keypad[10] = 1;
-    chip8_op_fx0a(chip8);
+    inst = 0xF80A;
+    chip8->registers[V8] = 0;
+    const uint16_t wait_pc = chip8->pc;
+    run_op(chip8, chip8_op_fx0a, inst);
+    assert(chip8->pc == wait_pc - 2);
+    assert(chip8->registers[V8] == 0);
+    assert(CHIP8_HALTED(chip8));
+    // the key only counts once it's released
+    chip8_key(chip8, 10, true);
+    assert(CHIP8_HALTED(chip8));
+    chip8_key(chip8, 3, false);
+    assert(CHIP8_HALTED(chip8));
+    chip8_key(chip8, 10, false);
+    assert(!CHIP8_HALTED(chip8));
+    chip8->pc = wait_pc;
+    run_op(chip8, chip8_op_fx0a, inst);
     assert(chip8->registers[V8] == 0xA);
-    chip8->keypad[10] = 0;
+    assert(chip8->halt == 0);
 
     // LD DT, Vx
-    chip8->inst = 0xF315;
+    inst = 0xF315;
     chip8->registers[V3] = 140;
-    chip8_op_fx15(chip8);
+    run_op(chip8, chip8_op_fx15, inst);
     assert(chip8->delay_timer == 140);
 
     // LD ST, Vx
-    chip8->inst = 0xFE18;
+    inst = 0xFE18;
     chip8->registers[VE] = 140;
-    chip8_op_fx18(chip8);
+    run_op(chip8, chip8_op_fx18, inst);
     assert(chip8->sound_timer == 140);
 
     // ADD I, Vx
-    chip8->inst = 0xF11E;
+    inst = 0xF11E;
     chip8->registers[V1] = 11;
     chip8->index = 2;
-    chip8_op_fx1e(chip8);
+    run_op(chip8, chip8_op_fx1e, inst);
     assert(chip8->index == 13);
 
     // LD F, Vx
-    chip8->inst = 0xFD29;
+    inst = 0xFD29;
     chip8->registers[VD] = 0xA;
-    chip8_op_fx29(chip8);
+    run_op(chip8, chip8_op_fx29, inst);
     assert(chip8->index == (10 * 5 + FONTADDR));
     
     // LD B, Vx 
-    chip8->inst = 0xFE33;
+    inst = 0xFE33;
     chip8->registers[VE] = 127;
-    chip8_op_fx33(chip8);
+    run_op(chip8, chip8_op_fx33, inst);
     assert(chip8->memory[chip8->index] == 1);
     assert(chip8->memory[chip8->index + 1] == 2);
     assert(chip8->memory[chip8->index + 2] == 7);
    
     // LD [I], Vx
     chip8->index = 0x250;
-    chip8->inst = 0xFF55;
+    inst = 0xFF55;
     for (int i = V0; i <= VF; i++) {
         chip8->registers[i] = 251;
     }
-    chip8_op_fx55(chip8);
+    run_op(chip8, chip8_op_fx55, inst);
     for (size_t i = 0x250; i <= (0x250 + VF); i++) {
         assert(chip8->memory[i] == 251);
     }
     
     // LD Vx, [I]
     chip8->index = 0x250;
-    chip8->inst = 0xFF65;
+    inst = 0xFF65;
     for (size_t i = 0x250; i <= (0x250 + VF); i++) {
         chip8->memory[i] = 123;
     }
-    chip8_op_fx65(chip8);
+    run_op(chip8, chip8_op_fx65, inst);
     for (int i = V0; i <= VF; i++) {
         assert(chip8->registers[i] == 123);
     }
+
+    // saved states
+    uint8_t state[CHIP8_STATE_SIZE];
+    assert(chip8_save_state(chip8, state, sizeof(state)) == CHIP8_STATE_SIZE);
+    const struct Chip8 saved = *chip8;
+    chip8->registers[V0] = 0;
+    chip8->memory[0x250] = 0;
+    chip8->pc += 2;
+    chip8_random(chip8);
+    assert(chip8_load_state(chip8, state, sizeof(state)));
+    assert(memcmp(chip8->memory, saved.memory, MEMORYSIZ) == 0);
+    assert(memcmp(chip8->registers, saved.registers, REGISTERSIZ) == 0);
+    assert(chip8->pc == saved.pc && chip8->rng == saved.rng);
+    assert(!chip8_load_state(chip8, state, sizeof(state) - 1));
+    // states no machine could be in are refused
+    state[CHIP8_STATE_HEADER + offsetof(struct Chip8, sp)] = STACKSIZ;
+    assert(!chip8_load_state(chip8, state, sizeof(state)));
+    state[CHIP8_STATE_HEADER + offsetof(struct Chip8, sp)] = 0;
+    state[CHIP8_STATE_HEADER + offsetof(struct Chip8, halt)] = CHIP8_HALT_PRESS | 1;
+    assert(!chip8_load_state(chip8, state, sizeof(state)));
+    state[CHIP8_STATE_HEADER + offsetof(struct Chip8, halt)] = CHIP8_HALT_RELEASE | 1;
+    assert(chip8_load_state(chip8, state, sizeof(state)));
+    memset(state + CHIP8_STATE_HEADER + offsetof(struct Chip8, rng), 0, sizeof(uint32_t));
+    assert(!chip8_load_state(chip8, state, sizeof(state)));
+    chip8->halt = 0;
+
+    // idle loops are gone around all at once
+    chip8->pc = 0x300;
+    chip8->memory[0x300] = 0x13;
+    chip8->memory[0x301] = 0x00;
+    assert(chip8_run_block(chip8, 100) == 100);
+    assert(chip8->pc == 0x300);
+    // LD V1, DT; SE V1, 0; JP 0x300
+    chip8->memory[0x300] = 0xF1;
+    chip8->memory[0x301] = 0x07;
+    chip8->memory[0x302] = 0x31;
+    chip8->memory[0x303] = 0x00;
+    chip8->memory[0x304] = 0x13;
+    chip8->memory[0x305] = 0x00;
+    chip8->delay_timer = 5;
+    assert(chip8_run_block(chip8, 100) == 99);
+    assert(chip8->pc == 0x300 && chip8->registers[V1] == 5);
+    chip8->delay_timer = 0;
+    assert(chip8_run_block(chip8, 100) < 99);
+
+    // a frame replaced before it was taken still gets its rows drawn
+    struct Chip8Frames handoff;
+    chip8_frames_init(&handoff);
+    chip8->dirty_rows = 1u << 3;
+    chip8_frames_publish(&handoff, chip8);
+    chip8->dirty_rows = 1u << 5;
+    chip8_frames_publish(&handoff, chip8);
+    assert(chip8_frames_take(&handoff)->dirty_rows == (1u << 3 | 1u << 5));
+    assert(!chip8_frames_take(&handoff));
+    chip8_frames_publish(&handoff, chip8);
+    assert(chip8_frames_take(&handoff)->dirty_rows == 0);
+
+    // LD V0, n; LD ST, V0; JP self sounds for exactly n frames, even a single one
+    for (int n = 1; n <= 3; n++) {
+        struct Chip8 beep = chip8_new();
+        const uint8_t code[] = { 0x60, n, 0xF0, 0x18, 0x12, 0x04 };
+        memcpy(beep.memory + INSTADDR, code, sizeof(code));
+        struct Chip8Audio tone;
+        chip8_audio_init(&tone, AUDIO_RATE);
+        int sounded = 0;
+        for (int frame = 0; frame < 6; frame++) {
+            chip8_run_frame(&beep, IPF);
+            assert(chip8_audio_frame(&tone, &beep));
+            sounded += tone.gates[frame];
+        }
+        assert(sounded == n && tone.gates[0] && tone.gates[n - 1]);
+    }
+    // and a file rendered offline holds those frames of tone too, the samples after them only fading out
+    struct Chip8 beep = chip8_new();
+    const uint8_t code[] = { 0x60, 0x01, 0xF0, 0x18, 0x12, 0x04 };
+    memcpy(beep.memory + INSTADDR, code, sizeof(code));
+    struct Chip8AudioFile file;
+    chip8_audio_file_open(&file, "/dev/null", AUDIO_RATE);
+    int loud = 0;
+    for (int frame = 0; frame < 3; frame++) {
+        chip8_run_frame(&beep, IPF);
+        chip8_audio_file_frame(&file, &beep);
+        int sounding = 0;
+        for (int i = 0; i < file.audio.frame; i++) {
+            sounding += file.buffer[i] != 0;
+        }
+        loud += sounding > AUDIO_RAMP;
+    }
+    chip8_audio_file_close(&file);
+    assert(loud == 1);
 }
 #endif
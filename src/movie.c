@@ -0,0 +1,117 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "movie.h"
+
+struct Chip8Movie chip8_movie_new(uint64_t seed, int ipf) {
+    return (struct Chip8Movie) {
+        .seed = seed,
+        .ipf = ipf,
+        .frames = 0,
+        .inputs = NULL,
+        .count = 0,
+        .capacity = 0,
+        .next = 0,
+    };
+}
+
+void chip8_movie_free(struct Chip8Movie *movie) {
+    free(movie->inputs);
+    movie->inputs = NULL;
+    movie->count = movie->capacity = movie->next = 0;
+}
+
+static void movie_add(struct Chip8Movie *movie, long long frame, uint8_t key, bool down) {
+    if (movie->count == movie->capacity) {
+        movie->capacity = movie->capacity ? movie->capacity * 2 : 64;
+        movie->inputs = realloc(movie->inputs, movie->capacity * sizeof(struct Chip8MovieInput));
+        if (!movie->inputs) {
+            fputs("Error: Could not allocate the movie.", stderr);
+            exit(1);
+        }
+    }
+    movie->inputs[movie->count++] = (struct Chip8MovieInput) { .frame = frame, .key = key, .down = down };
+}
+
+void chip8_movie_key(struct Chip8Movie *movie, long long frame, struct Chip8 *chip8, uint8_t key, bool down) {
+    key %= KEYPADSIZ;
+    chip8_key(chip8, key, down);
+    movie_add(movie, frame, key, down);
+}
+
+void chip8_movie_record(struct Chip8Movie *movie, long long frame) {
+    movie->frames = frame + 1;
+}
+
+void chip8_movie_cut(struct Chip8Movie *movie, long long frame) {
+    while (movie->count && movie->inputs[movie->count - 1].frame >= frame) {
+        movie->count--;
+    }
+    if (movie->next > movie->count) {
+        movie->next = movie->count;
+    }
+    if (movie->frames > frame) {
+        movie->frames = frame;
+    }
+}
+
+void chip8_movie_play(struct Chip8Movie *movie, long long frame, struct Chip8 *chip8) {
+    while (movie->next < movie->count && movie->inputs[movie->next].frame <= frame) {
+        const struct Chip8MovieInput *input = &movie->inputs[movie->next++];
+        chip8_key(chip8, input->key, input->down);
+    }
+}
+
+void chip8_movie_save(const struct Chip8Movie *movie, const char *restrict filename) {
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        fputs("Error: Could not write the movie.", stderr);
+        exit(1);
+    }
+
+    fprintf(file, "chip8-movie %d\n", CHIP8_MOVIE_VERSION);
+    fprintf(file, "seed %016" PRIx64 "\n", movie->seed);
+    fprintf(file, "ipf %d\n", movie->ipf);
+    fprintf(file, "frames %lld\n", movie->frames);
+    for (int i = 0; i < movie->count; i++) {
+        fprintf(file, "%lld %X %d\n", movie->inputs[i].frame, movie->inputs[i].key, movie->inputs[i].down);
+    }
+
+    if (fclose(file)) {
+        fputs("Error: Could not write the movie.", stderr);
+        exit(1);
+    }
+}
+
+struct Chip8Movie chip8_movie_load(const char *restrict filename) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        fputs("Error: Could not open the movie.", stderr);
+        exit(1);
+    }
+
+    int version;
+    struct Chip8Movie movie = chip8_movie_new(0, IPF);
+    if (fscanf(file, "chip8-movie %d seed %" SCNx64 " ipf %d frames %lld", &version, &movie.seed, &movie.ipf, &movie.frames) != 4
+        || version != CHIP8_MOVIE_VERSION || movie.ipf <= 0) {
+        fputs("Error: Not a movie of this version.", stderr);
+        exit(1);
+    }
+
+    long long frame;
+    unsigned key;
+    int down;
+    while (fscanf(file, "%lld %x %d", &frame, &key, &down) == 3) {
+        if (key >= KEYPADSIZ || (down != 0 && down != 1) || (movie.count && frame < movie.inputs[movie.count - 1].frame)) {
+            fputs("Error: The movie is broken.", stderr);
+            exit(1);
+        }
+        movie_add(&movie, frame, key, down);
+    }
+    if (!feof(file)) {
+        fputs("Error: The movie is broken.", stderr);
+        exit(1);
+    }
+    fclose(file);
+    return movie;
+}
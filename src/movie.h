@@ -0,0 +1,56 @@
+#ifndef CHIP8_MOVIE
+#define CHIP8_MOVIE
+#include "cpu.h"
+
+#define CHIP8_MOVIE_VERSION 2
+
+// a key going down or up right before `frame` is run
+struct Chip8MovieInput {
+    long long frame;
+    uint8_t key;
+    bool down;
+};
+
+// Everything a run depends on besides its ROM: the seed of its random numbers, the
+// instructions per frame and every key going down or up, in order, with the frame it
+// came before. Keys only reach the machine between frames, through chip8_key, so playing
+// a movie back gives the same run every time, even for a key that was pressed and
+// released between two frames (which moves a wait for a key along).
+//
+// Movies are saved as text, a line for the version, the seed, the instructions per frame
+// and the length in frames, then a line per input with its frame, the key in hex and 1
+// for down or 0 for up:
+//
+//     chip8-movie 2
+//     seed 0000000000000000
+//     ipf 8
+//     frames 3600
+//     120 5 1
+//     121 5 0
+struct Chip8Movie {
+    uint64_t seed;
+    int ipf;
+    // frames that were recorded, or are played back
+    long long frames;
+    struct Chip8MovieInput *inputs;
+    int count;
+    int capacity;
+    // next input to be played back
+    int next;
+};
+
+struct Chip8Movie chip8_movie_new(uint64_t seed, int ipf);
+void chip8_movie_free(struct Chip8Movie *movie);
+
+// presses or releases `key` on `chip8` right before `frame` is run, and notes it
+void chip8_movie_key(struct Chip8Movie *movie, long long frame, struct Chip8 *chip8, uint8_t key, bool down);
+// notes that `frame` is run next
+void chip8_movie_record(struct Chip8Movie *movie, long long frame);
+// forgets everything from `frame` on, e.g. after going back in time
+void chip8_movie_cut(struct Chip8Movie *movie, long long frame);
+// presses and releases the keys of `frame` on `chip8`, before the frame is run. frames must be played in order
+void chip8_movie_play(struct Chip8Movie *movie, long long frame, struct Chip8 *chip8);
+
+void chip8_movie_save(const struct Chip8Movie *movie, const char *restrict filename);
+struct Chip8Movie chip8_movie_load(const char *restrict filename);
+#endif
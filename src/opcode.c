@@ -2,35 +2,57 @@
 #include <stdlib.h>
 #include "cpu.h"
 
+// the hash of row `y` of the screen holding `pixels`: a single multiply, which is cheap enough
+// to be done twice for every row drawn, and folded so the high bits reach the low ones
+static uint64_t chip8_row_hash(uint64_t pixels, size_t y) {
+    const uint64_t h = (pixels ^ (y + 1) * 0xC2B2AE3D27D4EB4F) * 0x9E3779B97F4A7C15;
+    return h ^ h >> 32;
+}
+
+uint64_t chip8_video_hash(const uint64_t *video) {
+    uint64_t hash = 0;
+    for (size_t y = 0; y < VIDEO_H; y++) {
+        hash ^= chip8_row_hash(video[y], y);
+    }
+    return hash;
+}
+
 // CLS
 // Clear the display
-void chip8_op_00e0(struct Chip8 *chip8) {
+void chip8_op_00e0(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    (void)inst;
+    for (size_t row = 0; row < VIDEO_H; row++) {
+        if (chip8->video[row]) {
+            chip8->dirty_rows |= 1u << row;
+            chip8->video_hash ^= chip8_row_hash(chip8->video[row], row) ^ chip8_row_hash(0, row);
+        }
+    }
     memset(chip8->video, 0, sizeof(chip8->video));
 }
 
 // RET
 // Return from a subroutine
 // PC is set to top of stack and 1 is substracted from SP
-void chip8_op_00ee(struct Chip8 *chip8) {
-    chip8->pc = chip8->stack[chip8->sp];
-    --chip8->sp;
+void chip8_op_00ee(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    (void)inst;
+    chip8->pc = chip8->stack[chip8->sp & (STACKSIZ - 1)];
+    chip8->sp = (chip8->sp - 1) & (STACKSIZ - 1);
 }
 
 // JP addr
 // Jump to location nnn
 // Sets PC to nnn
-void chip8_op_1nnn(struct Chip8 *chip8) {
-    uint16_t addr = chip8->inst & 0x0FFF;
-    chip8->pc = addr;
+void chip8_op_1nnn(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    chip8->pc = inst->nnn;
 }
 
 // CALL addr
 // Call subroutine at nnn
 // Increments SP then puts current PC on top of stack, then PC is set to nnn
-void chip8_op_2nnn(struct Chip8 *chip8) {
-    ++chip8->sp;
+void chip8_op_2nnn(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    chip8->sp = (chip8->sp + 1) & (STACKSIZ - 1);
     chip8->stack[chip8->sp] = chip8->pc;
-    chip8->pc = chip8->inst & 0x0FFF;
+    chip8->pc = inst->nnn;
 }
 
 // SE Vx, byte
@@ -38,11 +60,8 @@ void chip8_op_2nnn(struct Chip8 *chip8) {
 
 // The interpreter compares register Vx to kk, and if they are equal, increments the program counter by 2.
 
-void chip8_op_3xkk(struct Chip8 *chip8) {
-    uint8_t Vx = (chip8->inst & 0x0F00) >> 8;
-    uint8_t kk = chip8->inst & 0x00FF;
-
-    if (chip8->registers[Vx] == kk) {
+void chip8_op_3xkk(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    if (chip8->registers[inst->x] == inst->kk) {
         chip8->pc += 2;
     }
 }
@@ -50,11 +69,8 @@ void chip8_op_3xkk(struct Chip8 *chip8) {
 // SNE Vx, byte
 // Skips next instruction if Vx != kk
 // Increments PC by 2 if not equal
-void chip8_op_4xkk(struct Chip8 *chip8) {
-    uint8_t Vx = (chip8->inst & 0x0F00) >> 8;
-    uint8_t kk = chip8->inst & 0x00FF;
-
-    if (chip8->registers[Vx] != kk) {
+void chip8_op_4xkk(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    if (chip8->registers[inst->x] != inst->kk) {
         chip8->pc += 2;
     }
 }
@@ -62,68 +78,47 @@ void chip8_op_4xkk(struct Chip8 *chip8) {
 // SE Vx, Vy
 // Skips next instruction if Vx = Vy
 // Increments PC by 2 if equal
-void chip8_op_5xy0(struct Chip8 *chip8) {
-    uint8_t Vx = (chip8->inst & 0x0F00) >> 8;
-    uint8_t Vy = (chip8->inst & 0x00F0) >> 4;
-
-    if (chip8->registers[Vx] == chip8->registers[Vy]) {
+void chip8_op_5xy0(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    if (chip8->registers[inst->x] == chip8->registers[inst->y]) {
         chip8->pc += 2;
     }
 }
 
 // LD Vx, byte
 // Set Vx = kk
-void chip8_op_6xkk(struct Chip8 *chip8) {
-    uint8_t Vx = (chip8->inst & 0x0F00) >> 8;
-    uint8_t kk = chip8->inst & 0x00FF;
-
-    chip8->registers[Vx] = kk;
+void chip8_op_6xkk(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    chip8->registers[inst->x] = inst->kk;
 }
 
 // ADD Vx, byte
 // Set Vx = Vx + kk
-void chip8_op_7xkk(struct Chip8 *chip8) {
-    uint8_t Vx = (chip8->inst & 0x0F00) >> 8;
-    uint8_t kk = chip8->inst & 0x00FF;
-
-    chip8->registers[Vx] += kk;
+void chip8_op_7xkk(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    chip8->registers[inst->x] += inst->kk;
 }
 
 
 // LD Vx, Vy
 // Set Vx = Vy
-void chip8_op_8xy0(struct Chip8 *chip8) {
-    uint8_t Vx = (chip8->inst & 0x0F00) >> 8;
-    uint8_t Vy = (chip8->inst & 0x00F0) >> 4;
-
-    chip8->registers[Vx] = chip8->registers[Vy];
+void chip8_op_8xy0(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    chip8->registers[inst->x] = chip8->registers[inst->y];
 }
 
 // OR Vx, Vy
 // Set Vx = Vx | Vy
-void chip8_op_8xy1(struct Chip8 *chip8) {
-    uint8_t Vx = (chip8->inst & 0x0F00) >> 8;
-    uint8_t Vy = (chip8->inst & 0x00F0) >> 4;
-
-    chip8->registers[Vx] |= chip8->registers[Vy];
+void chip8_op_8xy1(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    chip8->registers[inst->x] |= chip8->registers[inst->y];
 }
 
 // AND Vx, Vy 
 // Set Vx = Vx & Vy
-void chip8_op_8xy2(struct Chip8 *chip8) {
-    uint8_t Vx = (chip8->inst & 0x0F00) >> 8;
-    uint8_t Vy = (chip8->inst & 0x00F0) >> 4;
-
-    chip8->registers[Vx] &= chip8->registers[Vy];
+void chip8_op_8xy2(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    chip8->registers[inst->x] &= chip8->registers[inst->y];
 }
 
 // XOR Vx, Vy
 // Set Vx = Vx ^ Vy
-void chip8_op_8xy3(struct Chip8 *chip8) {
-    uint8_t Vx = (chip8->inst & 0x0F00) >> 8;
-    uint8_t Vy = (chip8->inst & 0x00F0) >> 4;
-
-    chip8->registers[Vx] ^= chip8->registers[Vy];
+void chip8_op_8xy3(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    chip8->registers[inst->x] ^= chip8->registers[inst->y];
 }
 
 // ADD Vx, Vy
@@ -131,67 +126,49 @@ void chip8_op_8xy3(struct Chip8 *chip8) {
 // The values of Vx and Vy are added together. 
 // If the result is greater than 8 bits (i.e., > 255,) VF is set to 1, otherwise 0.
 // Only the lowest 8 bits of the result are kept, and stored in Vx.
-void chip8_op_8xy4(struct Chip8 *chip8) {
-    uint8_t Vx = (chip8->inst & 0x0F00) >> 8;
-    uint8_t Vy = (chip8->inst & 0x00F0) >> 4;
-
-    int sum = chip8->registers[Vx] + chip8->registers[Vy];
-    chip8->registers[Vx] = sum & 0xFF;
+void chip8_op_8xy4(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    int sum = chip8->registers[inst->x] + chip8->registers[inst->y];
+    chip8->registers[inst->x] = sum & 0xFF;
     chip8->registers[VF] = sum > 255 ? 1 : 0;
 }
 
 // SUB Vx, Vy
 // Set Vx = Vx - Vy
 // If Vx > Vy, then VF is set to 1, otherwise 0. Then Vy is subtracted from Vx, and the results stored in Vx.
-void chip8_op_8xy5(struct Chip8 *chip8) {
-    uint8_t Vx = (chip8->inst & 0x0F00) >> 8;
-    uint8_t Vy = (chip8->inst & 0x00F0) >> 4;
-
-    chip8->registers[Vx] -= chip8->registers[Vy];
-    chip8-> registers[VF] = chip8->registers[Vx] > chip8->registers[Vy] ? 1 : 0;
+void chip8_op_8xy5(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    chip8->registers[inst->x] -= chip8->registers[inst->y];
+    chip8-> registers[VF] = chip8->registers[inst->x] > chip8->registers[inst->y] ? 1 : 0;
 }
 
 // SHR Vx, {, Vy}
 // Set Vx = Vx >> 1.
 //If the least-significant bit of Vx is 1, then VF is set to 1, otherwise 0. Then Vx is divided by 2.
-void chip8_op_8xy6(struct Chip8 *chip8) {
-    uint8_t Vx = (chip8->inst & 0x0F00) >> 8;
-    // uint8_t Vy = (chip8->inst & 0x00F0) >> 4;
-
-    chip8->registers[Vx] >>= 1;
-    chip8-> registers[VF] = chip8->registers[Vx] & 1 ? 1 : 0;
+void chip8_op_8xy6(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    chip8->registers[inst->x] >>= 1;
+    chip8-> registers[VF] = chip8->registers[inst->x] & 1 ? 1 : 0;
 }
 
 // SUBN Vx, Vy
 // Set Vx = Vy - Vx, set VF = NOT borrow.
 // If Vy > Vx, then VF is set to 1, otherwise 0. Then Vx is subtracted from Vy, and the results stored in Vx.
-void chip8_op_8xy7(struct Chip8 *chip8) {
-    uint8_t Vx = (chip8->inst & 0x0F00) >> 8;
-    uint8_t Vy = (chip8->inst & 0x00F0) >> 4;
-
-    chip8->registers[Vx] = chip8->registers[Vy] - chip8->registers[Vx];
-    chip8-> registers[VF] = chip8->registers[Vy] > chip8->registers[Vx] ? 1 : 0;
+void chip8_op_8xy7(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    chip8->registers[inst->x] = chip8->registers[inst->y] - chip8->registers[inst->x];
+    chip8-> registers[VF] = chip8->registers[inst->y] > chip8->registers[inst->x] ? 1 : 0;
 }
 
 // SHL Vx {, Vy}
 // Set Vx = Vx SHL 1.
 // If the most-significant bit of Vx is 1, then VF is set to 1, otherwise to 0. Then Vx is multiplied by 2.
-void chip8_op_8xye(struct Chip8 *chip8) {
-    uint8_t Vx = (chip8->inst & 0x0F00) >> 8;
-    // uint8_t Vy = (chip8->inst & 0x00F0) >> 4;
-
-    chip8->registers[Vx] <<= 1;
-    chip8-> registers[VF] = chip8->registers[Vx] & 1 ? 1 : 0;
+void chip8_op_8xye(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    chip8->registers[inst->x] <<= 1;
+    chip8-> registers[VF] = chip8->registers[inst->x] & 1 ? 1 : 0;
 }
 
 // SNE Vx, Vy
 // Skip next instruction if Vx != Vy.
 // The values of Vx and Vy are compared, and if they are not equal, the program counter is increased by 2.
-void chip8_op_9xy0(struct Chip8 *chip8) {
-    uint8_t Vx = (chip8->inst & 0x0F00) >> 8;
-    uint8_t Vy = (chip8->inst & 0x00F0) >> 4;
-
-    if (chip8->registers[Vx] !=  chip8->registers[Vy]) {
+void chip8_op_9xy0(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    if (chip8->registers[inst->x] !=  chip8->registers[inst->y]) {
         chip8->pc += 2;
     }
 }
@@ -199,29 +176,23 @@ void chip8_op_9xy0(struct Chip8 *chip8) {
 // LD I, addr
 // Set I = nnn.
 // The value of register I is set to nnn 
-void chip8_op_annn(struct Chip8 *chip8) {
-    uint16_t nnn = chip8->inst & 0x0FFF;
-    chip8->index = nnn;
+void chip8_op_annn(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    chip8->index = inst->nnn;
 }
 
 // JP V0, addr
 // Jump to location nnn + V0.
 // The program counter is set to nnn plus the value of V0.
-void chip8_op_bnnn(struct Chip8 *chip8) {
-    uint8_t nnn = chip8->inst & 0x0FFF;
-    chip8->pc = nnn + chip8->registers[V0];
+void chip8_op_bnnn(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    chip8->pc = inst->nnn + chip8->registers[V0];
 }
 
 // RND Vx, byte
 // Set Vx = random byte AND kk.
 // The interpreter generates a random number from 0 to 255, which is then ANDed with the value kk.
 // The results are stored in Vx. See instruction 8xy2 for more information on AND.
-void chip8_op_cxkk(struct Chip8 *chip8) {
-    uint8_t Vx = (chip8->inst & 0x0F00) >> 8;
-    uint8_t kk = chip8->inst & 0x00FF;
-
-    int random = (rand() % 255) & kk;
-    chip8->registers[Vx] = random;
+void chip8_op_cxkk(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    chip8->registers[inst->x] = chip8_random(chip8) & inst->kk;
 }
 
 // DRW Vx, Vy, nibble
@@ -230,36 +201,34 @@ void chip8_op_cxkk(struct Chip8 *chip8) {
 // These bytes are then displayed as sprites on screen at coordinates (Vx, Vy). Sprites are XORed onto the existing screen.
 // If this causes any pixels to be erased, VF is set to 1, otherwise it is set to 0.
 // If the sprite is positioned so part of it is outside the coordinates of the display, it wraps around to the opposite side of the screen.
-void chip8_op_dxyn(struct Chip8 *chip8) {
-    uint8_t Vx = (chip8->inst & 0x0F00) >> 8;
-    uint8_t Vy = (chip8->inst & 0x00F0) >> 4;
-    uint8_t n = chip8->inst & 0x000F;
-
-    const uint8_t x = chip8->registers[Vx] % VIDEO_W;
-    const uint8_t y = chip8->registers[Vy] % VIDEO_H;
-
-    for (size_t row = 0; row < n; row++) {
-        uint8_t sprite_byte = chip8->memory[chip8->index + row];
-        for (size_t col = 0; col < 8; col++) {
-            uint8_t pixel = sprite_byte & (0x80 >> col);
-            uint32_t *screen_pixel = &chip8->video[(y + row) * VIDEO_W + (x + col)];
-
-            if (pixel) {
-                *screen_pixel  ^= 0xFFFFFFFF;
-            }
-
-            chip8->registers[VF] = *screen_pixel == 0xFFFFFFFF ? 1 : 0;
+void chip8_op_dxyn(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    const uint8_t x = chip8->registers[inst->x] % VIDEO_W;
+    const uint8_t y = chip8->registers[inst->y] % VIDEO_H;
+    uint64_t collision = 0;
+
+    for (size_t row = 0; row < inst->n; row++) {
+        // the sprite byte is lined up with x on the screen row, wrapping around its right edge
+        const uint64_t sprite_row = (uint64_t)chip8->memory[MEMORY_ADDR(chip8->index + row)] << (VIDEO_W - 8);
+        const uint64_t pixels = x ? sprite_row >> x | sprite_row << (VIDEO_W - x) : sprite_row;
+        const size_t screen_y = (y + row) % VIDEO_H;
+        uint64_t *screen_row = &chip8->video[screen_y];
+
+        collision |= *screen_row & pixels;
+        if (pixels) {
+            chip8->dirty_rows |= 1u << screen_y;
+            chip8->video_hash ^= chip8_row_hash(*screen_row, screen_y) ^ chip8_row_hash(*screen_row ^ pixels, screen_y);
         }
+        *screen_row ^= pixels;
     }
+
+    chip8->registers[VF] = collision ? 1 : 0;
 }
 
 // SKP Vx
 // Skip next instruction if key with the value of Vx is pressed.
 // Checks the keyboard, and if the key corresponding to the value of Vx is currently in the down position, PC is increased by 2.
-void chip8_op_ex9e(struct Chip8 *chip8) {
-    uint8_t Vx = (chip8->inst & 0x0F00) >> 8;
-
-    if (chip8->keypad[chip8->registers[Vx]]) {
+void chip8_op_ex9e(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    if (chip8->keypad[chip8->registers[inst->x] % KEYPADSIZ]) {
         chip8->pc += 2;
     }
 }
@@ -267,10 +236,8 @@ void chip8_op_ex9e(struct Chip8 *chip8) {
 // SKNP Vx
 // Skip next instruction if key with the value of Vx is not pressed.
 // Checks the keyboard, and if the key corresponding to the value of Vx is currently in the up position, PC is increased by 2.
-void chip8_op_exa1(struct Chip8 *chip8) {
-    uint8_t Vx = (chip8->inst & 0x0F00) >> 8;
-
-    if (!chip8->keypad[chip8->registers[Vx]]) {
+void chip8_op_exa1(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    if (!chip8->keypad[chip8->registers[inst->x] % KEYPADSIZ]) {
         chip8->pc += 2;
     }
 }
@@ -278,93 +245,93 @@ void chip8_op_exa1(struct Chip8 *chip8) {
 // LD Vx, DT
 // Set Vx = delay timer value.
 // The value of DT is placed into Vx.
-void chip8_op_fx07(struct Chip8 *chip8) {
-    uint8_t Vx = (chip8->inst  & 0x0F00) >> 8;
-    chip8->registers[Vx] = chip8->delay_timer;
+void chip8_op_fx07(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    chip8->registers[inst->x] = chip8->delay_timer;
 }
 
 // LD Vx, K
 // Wait for a key press, store the value of the key in Vx.
-// All execution stops until a key is pressed, then the value of that key is stored in Vx.
-void chip8_op_fx0a(struct Chip8 *chip8) {
-    uint8_t Vx = (chip8->inst  & 0x0F00) >> 8;
-
-    for (;;) {
-        for (int i = 0; i < KEYPADSIZ; i++) {
-            if (chip8->keypad[i]) {
-                chip8->registers[Vx] = i;
-                return;
-            }
+// All execution stops until a key is pressed and released again, then the value of that key is stored in Vx.
+void chip8_op_fx0a(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    // the key was pressed and released while the CPU was halted
+    if ((chip8->halt & ~CHIP8_HALT_KEY) == CHIP8_HALT_DONE) {
+        chip8->registers[inst->x] = chip8->halt & CHIP8_HALT_KEY;
+        chip8->halt = 0;
+        return;
+    }
+
+    // like the original interpreter, a key that's already down counts as pressed,
+    // and the key is only taken once it's released
+    chip8->halt = CHIP8_HALT_PRESS;
+    for (int i = 0; i < KEYPADSIZ; i++) {
+        if (chip8->keypad[i]) {
+            chip8->halt = CHIP8_HALT_RELEASE | i;
+            break;
         }
     }
+    // the CPU halts here (see chip8_run) and runs this again once chip8_key saw the release
+    chip8->pc -= 2;
 }
 
 // LD DT, Vx
 // Set delay timer = Vx.
 // DT is set equal to the value of Vx.
-void chip8_op_fx15(struct Chip8 *chip8) {
-    uint8_t Vx = (chip8->inst  & 0x0F00) >> 8;
-    chip8->delay_timer = chip8->registers[Vx];
+void chip8_op_fx15(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    chip8->delay_timer = chip8->registers[inst->x];
 }
 
 // LD ST, Vx
 // Set sound timer = Vx.
 // ST is set equal to the value of Vx.
-void chip8_op_fx18(struct Chip8 *chip8) {
-    uint8_t Vx = (chip8->inst  & 0x0F00) >> 8;
-    chip8->sound_timer = chip8->registers[Vx];
+void chip8_op_fx18(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    chip8->sound_timer = chip8->registers[inst->x];
 }
 
 // ADD I, Vx
 // Set I = I + Vx.
 // The values of I and Vx are added, and the results are stored in I.
-void chip8_op_fx1e(struct Chip8 *chip8) {
-    uint8_t Vx = (chip8->inst  & 0x0F00) >> 8;
-    chip8->index += chip8->registers[Vx];
+void chip8_op_fx1e(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    chip8->index += chip8->registers[inst->x];
 }
 
 // LD F, Vx
 // Set I = location of sprite for digit Vx.
 // The value of I is set to the location for the hexadecimal sprite corresponding to the value of Vx. See section 2.4,
 // Display, for more information on the Chip-8 hexadecimal font.
-void chip8_op_fx29(struct Chip8 *chip8) {
-    uint8_t Vx = (chip8->inst  & 0x0F00) >> 8;
-    chip8->index = chip8->registers[Vx] * 5 + FONTADDR;
+void chip8_op_fx29(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    chip8->index = chip8->registers[inst->x] * 5 + FONTADDR;
 }
 
 // LD B, Vx
 // Store BCD representation of Vx in memory locations I, I+1, and I+2.
 // The interpreter takes the decimal value of Vx, and places the hundreds digit in memory at location in I,
 // the tens digit at location I+1, and the ones digit at location I+2.
-void chip8_op_fx33(struct Chip8 *chip8) {
-    uint8_t Vx = (chip8->inst  & 0x0F00) >> 8;
-    uint8_t value = chip8->registers[Vx];
+void chip8_op_fx33(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    uint8_t value = chip8->registers[inst->x];
 
-    chip8->memory[chip8->index + 2] = value % 10;
+    chip8->memory[MEMORY_ADDR(chip8->index + 2)] = value % 10;
     value /= 10;
-    chip8->memory[chip8->index + 1] = value % 10;
+    chip8->memory[MEMORY_ADDR(chip8->index + 1)] = value % 10;
     value /= 10;
-    chip8->memory[chip8->index] = value % 10;
+    chip8->memory[MEMORY_ADDR(chip8->index)] = value % 10;
+    chip8_invalidate(chip8, chip8->index, 3);
 }
 
 // LD [I], Vx
 // Store registers V0 through Vx in memory starting at location I.
 // The interpreter copies the values of registers V0 through Vx into memory, starting at the address in I.
-void chip8_op_fx55(struct Chip8 *chip8) {
-    uint8_t Vx = (chip8->inst  & 0x0F00) >> 8;
-
-    for (size_t i = V0; i <= Vx; i++) {
-        chip8->memory[chip8->index + i] = chip8->registers[i];
+void chip8_op_fx55(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    for (size_t i = V0; i <= inst->x; i++) {
+        chip8->memory[MEMORY_ADDR(chip8->index + i)] = chip8->registers[i];
     }
+    chip8_invalidate(chip8, chip8->index, inst->x + 1);
 }
 
 // LD Vx, [I]
 // Read registers V0 through Vx from memory starting at location I.
 // The interpreter reads values from memory starting at location I into registers V0 through Vx.
-void chip8_op_fx65(struct Chip8 *chip8) {
-    uint8_t Vx = (chip8->inst  & 0x0F00) >> 8;
-
-    for (uint8_t i = V0; i <= Vx; i++) {
-        chip8->registers[i] = chip8->memory[chip8->index + i];
+void chip8_op_fx65(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    for (uint8_t i = V0; i <= inst->x; i++) {
+        chip8->registers[i] = chip8->memory[MEMORY_ADDR(chip8->index + i)];
     }
 }
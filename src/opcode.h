@@ -4,109 +4,109 @@
 
 // CLS
 // Clear the display
-void chip8_op_00e0(struct Chip8 *chip8);
+void chip8_op_00e0(struct Chip8 *chip8, const struct Chip8Inst *inst);
 
 // RET
 // Return from a subroutine
 // PC is set to top of stack and 1 is substracted from SP
-void chip8_op_00ee(struct Chip8 *chip8);
+void chip8_op_00ee(struct Chip8 *chip8, const struct Chip8Inst *inst);
 
 // JP addr
 // Jump to location nnn
 // Sets PC to nnn
-void chip8_op_1nnn(struct Chip8 *chip8);
+void chip8_op_1nnn(struct Chip8 *chip8, const struct Chip8Inst *inst);
 
 // CALL addr
 // Call subroutine at nnn
 // Increments SP then puts current PC on top of stack, then PC is set to nnn
-void chip8_op_2nnn(struct Chip8 *chip8);
+void chip8_op_2nnn(struct Chip8 *chip8, const struct Chip8Inst *inst);
 
 // SE Vx, byte
 // Skip next instruction if Vx = kk
 // Increments PC by 2 if equal
-void chip8_op_3xkk(struct Chip8 *chip8);
+void chip8_op_3xkk(struct Chip8 *chip8, const struct Chip8Inst *inst);
 
 // SNE Vx, byte
 // Skips next instruction if Vx != kk
 // Increments PC by 2 if not equal
-void chip8_op_4xkk(struct Chip8 *chip8);
+void chip8_op_4xkk(struct Chip8 *chip8, const struct Chip8Inst *inst);
 
 // SE Vx, Vy
 // Skips next instruction if Vx = Vy
 // Increments PC by 2 if equal
-void chip8_op_5xy0(struct Chip8 *chip8);
+void chip8_op_5xy0(struct Chip8 *chip8, const struct Chip8Inst *inst);
 
 // LD Vx, byte
 // Set Vx = kk
-void chip8_op_6xkk(struct Chip8 *chip8);
+void chip8_op_6xkk(struct Chip8 *chip8, const struct Chip8Inst *inst);
 
 // ADD Vx, byte
 // Set Vx = Vx + kk
-void chip8_op_7xkk(struct Chip8 *chip8);
+void chip8_op_7xkk(struct Chip8 *chip8, const struct Chip8Inst *inst);
 
 // LD Vx, Vy
 // Set Vx = Vy
-void chip8_op_8xy0(struct Chip8 *chip8);
+void chip8_op_8xy0(struct Chip8 *chip8, const struct Chip8Inst *inst);
 
 // OR Vx, Vy
 // Set Vx = Vx | Vy
-void chip8_op_8xy1(struct Chip8 *chip8);
+void chip8_op_8xy1(struct Chip8 *chip8, const struct Chip8Inst *inst);
 
 // AND Vx, Vy 
 // Set Vx = Vx & Vy
-void chip8_op_8xy2(struct Chip8 *chip8);
+void chip8_op_8xy2(struct Chip8 *chip8, const struct Chip8Inst *inst);
 
 // XOR Vx, Vy
 // Set Vx = Vx ^ Vy
-void chip8_op_8xy3(struct Chip8 *chip8);
+void chip8_op_8xy3(struct Chip8 *chip8, const struct Chip8Inst *inst);
 
 // ADD Vx, Vy
 // Set Vx = Vx & Vy, VF = carry
 // The values of Vx and Vy are added together. 
 // If the result is greater than 8 bits (i.e., > 255,) VF is set to 1, otherwise 0.
 // Only the lowest 8 bits of the result are kept, and stored in Vx.
-void chip8_op_8xy4(struct Chip8 *chip8);
+void chip8_op_8xy4(struct Chip8 *chip8, const struct Chip8Inst *inst);
 
 // SUB Vx, Vy
 // Set Vx = Vx - Vy
 // If Vx > Vy, then VF is set to 1, otherwise 0. Then Vy is subtracted from Vx, and the results stored in Vx.
-void chip8_op_8xy5(struct Chip8 *chip8);
+void chip8_op_8xy5(struct Chip8 *chip8, const struct Chip8Inst *inst);
 
 // SHR Vx, {, Vy}
 // Set Vx = Vx >> 1.
 //If the least-significant bit of Vx is 1, then VF is set to 1, otherwise 0. Then Vx is divided by 2.
-void chip8_op_8xy6(struct Chip8 *chip8);
+void chip8_op_8xy6(struct Chip8 *chip8, const struct Chip8Inst *inst);
 
 // SUBN Vx, Vy
 // Set Vx = Vy - Vx, set VF = NOT borrow.
 // If Vy > Vx, then VF is set to 1, otherwise 0. Then Vx is subtracted from Vy, and the results stored in Vx.
-void chip8_op_8xy7(struct Chip8 *chip8);
+void chip8_op_8xy7(struct Chip8 *chip8, const struct Chip8Inst *inst);
 
 // SHL Vx {, Vy}
 // Set Vx = Vx SHL 1.
 // If the most-significant bit of Vx is 1, then VF is set to 1, otherwise to 0. Then Vx is multiplied by 2.
-void chip8_op_8xye(struct Chip8 *chip8);
+void chip8_op_8xye(struct Chip8 *chip8, const struct Chip8Inst *inst);
 
 // SNE Vx, Vy
 // Skip next instruction if Vx != Vy.
 // The values of Vx and Vy are compared, and if they are not equal, the program counter is increased by 2.
-void chip8_op_9xy0(struct Chip8 *chip8);
+void chip8_op_9xy0(struct Chip8 *chip8, const struct Chip8Inst *inst);
 
 // LD I, addr
 // Set I = nnn.
 // The value of register I is set to nnn 
-void chip8_op_annn(struct Chip8 *chip8);
+void chip8_op_annn(struct Chip8 *chip8, const struct Chip8Inst *inst);
 
 // JP V0, addr
 // Jump to location nnn + V0.
 // The program counter is set to nnn plus the value of V0.
-void chip8_op_bnnn(struct Chip8 *chip8);
+void chip8_op_bnnn(struct Chip8 *chip8, const struct Chip8Inst *inst);
 
 // RND Vx, byte
 // Set Vx = random byte AND kk.
 // The interpreter generates a random number from 0 to 255, which is then ANDed with the value kk.
 // The results are stored in Vx. See instruction 8xy2 for more information on AND.
-void chip8_op_cxkk(struct Chip8 *chip8);
+void chip8_op_cxkk(struct Chip8 *chip8, const struct Chip8Inst *inst);
 
 // DRW Vx, Vy, nibble
 // Display n-byte sprite starting at memory location I at (Vx, Vy), set VF = collision.
@@ -114,64 +114,64 @@ void chip8_op_cxkk(struct Chip8 *chip8);
 // These bytes are then displayed as sprites on screen at coordinates (Vx, Vy). Sprites are XORed onto the existing screen.
 // If this causes any pixels to be erased, VF is set to 1, otherwise it is set to 0.
 // If the sprite is positioned so part of it is outside the coordinates of the display, it wraps around to the opposite side of the screen.
-void chip8_op_dxyn(struct Chip8 *chip8);
+void chip8_op_dxyn(struct Chip8 *chip8, const struct Chip8Inst *inst);
 
 // SKP Vx
 // Skip next instruction if key with the value of Vx is pressed.
 // Checks the keyboard, and if the key corresponding to the value of Vx is currently in the down position, PC is increased by 2.
-void chip8_op_ex9e(struct Chip8 *chip8);
+void chip8_op_ex9e(struct Chip8 *chip8, const struct Chip8Inst *inst);
 
 
 // SKNP Vx
 // Skip next instruction if key with the value of Vx is not pressed.
 // Checks the keyboard, and if the key corresponding to the value of Vx is currently in the up position, PC is increased by 2.
-void chip8_op_exa1(struct Chip8 *chip8);
+void chip8_op_exa1(struct Chip8 *chip8, const struct Chip8Inst *inst);
 
 // LD Vx, DT
 // Set Vx = delay timer value.
 // The value of DT is placed into Vx.
-void chip8_op_fx07(struct Chip8 *chip8);
+void chip8_op_fx07(struct Chip8 *chip8, const struct Chip8Inst *inst);
 
 // LD Vx, K
 // Wait for a key press, store the value of the key in Vx.
-// All execution stops until a key is pressed, then the value of that key is stored in Vx.
-void chip8_op_fx0a(struct Chip8 *chip8);
+// All execution stops until a key is pressed and released again, then the value of that key is stored in Vx.
+void chip8_op_fx0a(struct Chip8 *chip8, const struct Chip8Inst *inst);
 
 // LD DT, Vx
 // Set delay timer = Vx.
 // DT is set equal to the value of Vx.
-void chip8_op_fx15(struct Chip8 *chip8);
+void chip8_op_fx15(struct Chip8 *chip8, const struct Chip8Inst *inst);
 
 // LD ST, Vx
 // Set sound timer = Vx.
 // ST is set equal to the value of Vx.
-void chip8_op_fx18(struct Chip8 *chip8);
+void chip8_op_fx18(struct Chip8 *chip8, const struct Chip8Inst *inst);
 
 // Fx1E - ADD I, Vx
 // Set I = I + Vx.
 // The values of I and Vx are added, and the results are stored in I.
-void chip8_op_fx1e(struct Chip8 *chip8);
+void chip8_op_fx1e(struct Chip8 *chip8, const struct Chip8Inst *inst);
  
 // LD F, Vx
 // Set I = location of sprite for digit Vx.
 // The value of I is set to the location for the hexadecimal sprite corresponding to the value of Vx. See section 2.4,
 // Display, for more information on the Chip-8 hexadecimal font.
-void chip8_op_fx29(struct Chip8 *chip8);
+void chip8_op_fx29(struct Chip8 *chip8, const struct Chip8Inst *inst);
 
 // LD B, Vx
 // Store BCD representation of Vx in memory locations I, I+1, and I+2.
 // The interpreter takes the decimal value of Vx, and places the hundreds digit in memory at location in I,
 // the tens digit at location I+1, and the ones digit at location I+2.
-void chip8_op_fx33(struct Chip8 *chip8);
+void chip8_op_fx33(struct Chip8 *chip8, const struct Chip8Inst *inst);
 
 // LD [I], Vx
 // Store registers V0 through Vx in memory starting at location I.
 // The interpreter copies the values of registers V0 through Vx into memory, starting at the address in I.
-void chip8_op_fx55(struct Chip8 *chip8);
+void chip8_op_fx55(struct Chip8 *chip8, const struct Chip8Inst *inst);
 
 // LD Vx, [I]
 // Read registers V0 through Vx from memory starting at location I.
 // The interpreter reads values from memory starting at location I into registers V0 through Vx.
-void chip8_op_fx65(struct Chip8 *chip8);
+void chip8_op_fx65(struct Chip8 *chip8, const struct Chip8Inst *inst);
 
 #endif
@@ -0,0 +1,111 @@
+#include <stdlib.h>
+#include <time.h>
+#include "profile.h"
+#include "opcode.h"
+#include "disasm.h"
+
+struct Chip8Profile *chip8_profile_new(void) {
+    struct Chip8Profile *profile = calloc(1, sizeof(struct Chip8Profile));
+    if (!profile) {
+        fputs("Error: Could not allocate the profile.", stderr);
+        exit(1);
+    }
+    return profile;
+}
+
+void chip8_profile_free(struct Chip8Profile *profile) {
+    free(profile);
+}
+
+#ifdef CHIP8_PROFILER
+static uint64_t profile_ns(void) {
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void chip8_profile_exec(struct Chip8 *chip8, const struct Chip8Inst *inst) {
+    struct Chip8Profile *profile = chip8->profile;
+    const uint16_t pc = MEMORY_ADDR(chip8->pc - 2);
+    // counted before it runs, it may write over itself
+    const uint16_t opcode = chip8->memory[pc] << 8 | chip8->memory[MEMORY_ADDR(pc + 1)];
+    profile->opcodes[opcode]++;
+    profile->pcs[pc]++;
+    profile->instructions++;
+
+    if (inst->exec != chip8_op_dxyn) {
+        inst->exec(chip8, inst);
+        return;
+    }
+    const uint64_t start = profile_ns();
+    inst->exec(chip8, inst);
+    profile->draw_ns += profile_ns() - start;
+    profile->draws++;
+}
+#endif
+
+struct ProfileCount {
+    const char *name;
+    uint16_t addr;
+    uint64_t count;
+};
+
+static int profile_by_count(const void *a, const void *b) {
+    const struct ProfileCount *x = a;
+    const struct ProfileCount *y = b;
+    return x->count < y->count ? 1 : x->count > y->count ? -1 : 0;
+}
+
+void chip8_profile_report(const struct Chip8Profile *profile, const struct Chip8 *chip8, int top, FILE *out) {
+    const double total = profile->instructions ? profile->instructions : 1;
+    fprintf(out, "instructions: %llu in %llu frames, %.1f per frame\n",
+            (unsigned long long)profile->instructions, (unsigned long long)profile->frames,
+            profile->frames ? profile->instructions / (double)profile->frames : 0.0);
+    fprintf(out, "drawing: %llu DRW in %.3f ms, %.0f ns each\n",
+            (unsigned long long)profile->draws, profile->draw_ns / 1e6,
+            profile->draws ? profile->draw_ns / (double)profile->draws : 0.0);
+
+    static struct ProfileCount pcs[MEMORYSIZ];
+    for (int addr = 0; addr < MEMORYSIZ; addr++) {
+        pcs[addr] = (struct ProfileCount) { .addr = addr, .count = profile->pcs[addr] };
+    }
+    qsort(pcs, MEMORYSIZ, sizeof(pcs[0]), profile_by_count);
+
+    fprintf(out, "\nhottest addresses:\n");
+    for (int i = 0; i < top && i < MEMORYSIZ && pcs[i].count; i++) {
+        const uint16_t addr = pcs[i].addr;
+        char assembly[32];
+        chip8_disassemble(chip8->memory[addr] << 8 | chip8->memory[MEMORY_ADDR(addr + 1)], assembly, sizeof(assembly));
+        fprintf(out, "  0x%03X %12llu %5.1f%%  %s\n", addr, (unsigned long long)pcs[i].count, pcs[i].count * 100 / total, assembly);
+    }
+
+    // the opcodes are summed up by the instruction they are
+    struct ProfileCount kinds[64];
+    int kind_count = 0;
+    for (int opcode = 0; opcode < 0x10000; opcode++) {
+        if (!profile->opcodes[opcode]) {
+            continue;
+        }
+        const char *name = chip8_opcode_name(opcode);
+        int k = 0;
+        while (k < kind_count && kinds[k].name != name) {
+            k++;
+        }
+        if (k == kind_count) {
+            kinds[kind_count++] = (struct ProfileCount) { .name = name, .count = 0 };
+        }
+        kinds[k].count += profile->opcodes[opcode];
+    }
+    qsort(kinds, kind_count, sizeof(kinds[0]), profile_by_count);
+
+    fprintf(out, "\ninstructions:\n");
+    for (int k = 0; k < kind_count; k++) {
+        const double share = kinds[k].count * 100 / total;
+        fprintf(out, "  %-4s %12llu %5.1f%%  ", kinds[k].name, (unsigned long long)kinds[k].count, share);
+        // a # for every 2%, and one at least for whatever ran at all
+        for (int bar = 0; bar < share / 2 || bar == 0; bar++) {
+            fputc('#', out);
+        }
+        fputc('\n', out);
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef CHIP8_PROFILE
+#define CHIP8_PROFILE
+#include <stdio.h>
+#include "cpu.h"
+
+// Counts of where a machine spends its instructions, for builds with CHIP8_PROFILER
+// defined (meson's `profile` option). A machine is profiled while its `profile` points
+// at one of these. Without CHIP8_PROFILER machines have no `profile`, and the hooks in
+// the interpreter are empty.
+struct Chip8Profile {
+    // runs of every opcode, and of the instructions at every address
+    uint64_t opcodes[0x10000];
+    uint64_t pcs[MEMORYSIZ];
+    uint64_t instructions;
+    uint64_t frames;
+    // DRW instructions run and the nanoseconds they took
+    uint64_t draws;
+    uint64_t draw_ns;
+};
+
+#ifdef CHIP8_PROFILER
+// runs `inst`, the instruction just before PC, counting it if the machine is being profiled
+#define CHIP8_PROFILE_EXEC(chip8, inst) \
+    ((chip8)->profile ? chip8_profile_exec((chip8), (inst)) : (inst)->exec((chip8), (inst)))
+#define CHIP8_PROFILE_FRAME(chip8) \
+    ((chip8)->profile ? (void)(chip8)->profile->frames++ : (void)0)
+// native code runs whole blocks at once, so it's left alone while profiling
+#define CHIP8_PROFILING(chip8) ((chip8)->profile != NULL)
+#else
+#define CHIP8_PROFILE_EXEC(chip8, inst) ((inst)->exec((chip8), (inst)))
+#define CHIP8_PROFILE_FRAME(chip8) ((void)0)
+#define CHIP8_PROFILING(chip8) false
+#endif
+
+// addresses listed in a report by default
+#define CHIP8_PROFILE_TOP 20
+
+struct Chip8Profile *chip8_profile_new(void);
+void chip8_profile_free(struct Chip8Profile *profile);
+
+void chip8_profile_exec(struct Chip8 *chip8, const struct Chip8Inst *inst);
+
+// writes the `top` addresses the most instructions were run at, with the instruction there now,
+// how often every kind of instruction was run, and the instructions run per frame
+void chip8_profile_report(const struct Chip8Profile *profile, const struct Chip8 *chip8, int top, FILE *out);
+#endif
@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rewind.h"
+
+// what keyframes are stored against
+static const uint8_t rewind_zeros[CHIP8_STATE_SIZE];
+
+// equal bytes it takes to end a run, fewer are cheaper to store as part of it than to skip
+#define REWIND_GAP 4
+
+struct Chip8Rewind *chip8_rewind_new(int frames, size_t bytes) {
+    struct Chip8Rewind *rewind = malloc(sizeof(struct Chip8Rewind));
+    const size_t index = frames * sizeof(struct Chip8RewindFrame);
+    // room for at least two keyframes and their frames no matter what
+    if (!rewind || frames < 2 || bytes < sizeof(struct Chip8Rewind) + index + 4 * sizeof(rewind->encoded)) {
+        fputs("Error: Not enough memory for rewinding.", stderr);
+        exit(1);
+    }
+
+    rewind->capacity = bytes - sizeof(struct Chip8Rewind) - index;
+    rewind->data = malloc(rewind->capacity);
+    rewind->frames = malloc(index);
+    if (!rewind->data || !rewind->frames) {
+        fputs("Error: Not enough memory for rewinding.", stderr);
+        exit(1);
+    }
+    rewind->end = 0;
+    rewind->max_frames = frames;
+    rewind->first = 0;
+    rewind->count = 0;
+    rewind->interval = REWIND_KEYFRAME;
+    return rewind;
+}
+
+void chip8_rewind_free(struct Chip8Rewind *rewind) {
+    if (!rewind) {
+        return;
+    }
+    free(rewind->data);
+    free(rewind->frames);
+    free(rewind);
+}
+
+// stores `state` XORed with `base` as runs of a 16 bit offset from the end of the previous run,
+// a 16 bit length and that many XORed bytes, leaving out what is the same in both
+static size_t rewind_encode(const uint8_t *state, const uint8_t *base, uint8_t *out) {
+    uint8_t *const start = out;
+    size_t pos = 0;
+    while (pos < CHIP8_STATE_SIZE) {
+        size_t from = pos;
+        // most of the state is the same, so it's skipped a word at a time
+        while (from + sizeof(uint64_t) <= CHIP8_STATE_SIZE) {
+            uint64_t a, b;
+            memcpy(&a, state + from, sizeof(a));
+            memcpy(&b, base + from, sizeof(b));
+            if (a != b) {
+                break;
+            }
+            from += sizeof(uint64_t);
+        }
+        while (from < CHIP8_STATE_SIZE && state[from] == base[from]) {
+            from++;
+        }
+        if (from == CHIP8_STATE_SIZE) {
+            break;
+        }
+
+        size_t to = from;
+        for (int same = 0; to < CHIP8_STATE_SIZE && same < REWIND_GAP; to++) {
+            same = state[to] == base[to] ? same + 1 : 0;
+        }
+        // the equal bytes that ended the run aren't part of it
+        while (state[to - 1] == base[to - 1]) {
+            to--;
+        }
+
+        const size_t skip = from - pos;
+        const size_t len = to - from;
+        *out++ = skip & 0xFF;
+        *out++ = skip >> 8;
+        *out++ = len & 0xFF;
+        *out++ = len >> 8;
+        for (size_t i = from; i < to; i++) {
+            *out++ = state[i] ^ base[i];
+        }
+        pos = to;
+    }
+    return out - start;
+}
+
+// XORs the runs of an encoded frame back into `state`, which holds what it was stored against
+static void rewind_decode(const uint8_t *in, size_t size, uint8_t *state) {
+    const uint8_t *const end = in + size;
+    size_t pos = 0;
+    while (in < end) {
+        pos += in[0] | in[1] << 8;
+        const size_t len = in[2] | in[3] << 8;
+        in += 4;
+        for (size_t i = 0; i < len; i++) {
+            state[pos++] ^= *in++;
+        }
+    }
+}
+
+static struct Chip8RewindFrame *rewind_frame(struct Chip8Rewind *rewind, int i) {
+    return &rewind->frames[(rewind->first + i) % rewind->max_frames];
+}
+
+// drops the oldest keyframe and every frame stored against it
+static void rewind_drop(struct Chip8Rewind *rewind) {
+    do {
+        rewind->first = (rewind->first + 1) % rewind->max_frames;
+        rewind->count--;
+    } while (rewind->count && rewind_frame(rewind, 0)->back);
+
+    if (!rewind->count) {
+        rewind->first = 0;
+        rewind->end = 0;
+    }
+}
+
+// makes room for `size` bytes, returns where they go
+static size_t rewind_place(struct Chip8Rewind *rewind, size_t size) {
+    if (rewind->count == rewind->max_frames) {
+        rewind_drop(rewind);
+    }
+
+    while (rewind->count) {
+        const uint32_t oldest = rewind_frame(rewind, 0)->offset;
+        const uint32_t newest = rewind_frame(rewind, rewind->count - 1)->offset;
+        if (oldest > newest) {
+            // the frames wrapped around the end of `data`, the free space is between them
+            if (rewind->end + size <= oldest) {
+                return rewind->end;
+            }
+        } else {
+            if (rewind->end + size <= rewind->capacity) {
+                return rewind->end;
+            }
+            if (size <= oldest) {
+                return 0;
+            }
+        }
+        rewind_drop(rewind);
+    }
+    return 0;
+}
+
+void chip8_rewind_record(struct Chip8Rewind *rewind, struct Chip8 *chip8) {
+    chip8_save_state(chip8, rewind->state, sizeof(rewind->state));
+
+    const struct Chip8RewindFrame *newest = rewind->count ? rewind_frame(rewind, rewind->count - 1) : NULL;
+    uint16_t back = newest && newest->back + 1 < rewind->interval ? newest->back + 1 : 0;
+    size_t size = rewind_encode(rewind->state, back ? rewind->key : rewind_zeros, rewind->encoded);
+    size_t offset = rewind_place(rewind, size);
+
+    // making room dropped the keyframe this frame was stored against, so it becomes one itself
+    if (back && !rewind->count) {
+        back = 0;
+        size = rewind_encode(rewind->state, rewind_zeros, rewind->encoded);
+        offset = rewind_place(rewind, size);
+    }
+
+    memcpy(rewind->data + offset, rewind->encoded, size);
+    *rewind_frame(rewind, rewind->count++) = (struct Chip8RewindFrame) {
+        .offset = offset,
+        .size = size,
+        .back = back,
+    };
+    rewind->end = offset + size;
+    if (!back) {
+        memcpy(rewind->key, rewind->state, sizeof(rewind->key));
+    }
+}
+
+bool chip8_rewind_step(struct Chip8Rewind *rewind, struct Chip8 *chip8) {
+    if (rewind->count < 2) {
+        return false;
+    }
+
+    const bool was_key = !rewind_frame(rewind, --rewind->count)->back;
+    const struct Chip8RewindFrame *newest = rewind_frame(rewind, rewind->count - 1);
+    rewind->end = newest->offset + newest->size;
+    // going back past a keyframe means the previous one is needed again
+    if (was_key) {
+        const struct Chip8RewindFrame *key = rewind_frame(rewind, rewind->count - 1 - newest->back);
+        memset(rewind->key, 0, sizeof(rewind->key));
+        rewind_decode(rewind->data + key->offset, key->size, rewind->key);
+    }
+
+    memcpy(rewind->state, rewind->key, sizeof(rewind->state));
+    if (newest->back) {
+        rewind_decode(rewind->data + newest->offset, newest->size, rewind->state);
+    }
+    return chip8_load_state(chip8, rewind->state, sizeof(rewind->state));
+}
@@ -0,0 +1,51 @@
+#ifndef CHIP8_REWIND
+#define CHIP8_REWIND
+#include <stddef.h>
+#include "cpu.h"
+#include "state.h"
+
+// a full state is kept every this many frames by default
+#define REWIND_KEYFRAME 60
+
+// where a recorded frame is kept in `data`
+struct Chip8RewindFrame {
+    uint32_t offset;
+    uint32_t size;
+    // frames back to the keyframe it was stored against, 0 for keyframes themselves
+    uint16_t back;
+};
+
+// The last frames of a machine, to go back through them. Every frame is stored as its
+// saved state XORed with the one of the latest keyframe (a frame that is stored against
+// nothing), which leaves zeros wherever nothing changed, and those runs of zeros are
+// skipped. The frames are kept in a ring of a fixed amount of bytes, and once it's full
+// the oldest keyframe is dropped along with the frames that were stored against it.
+struct Chip8Rewind {
+    uint8_t *data;
+    size_t capacity;
+    // where the next frame goes in `data`
+    size_t end;
+    // ring of the recorded frames, oldest first
+    struct Chip8RewindFrame *frames;
+    int max_frames;
+    int first;
+    int count;
+    // frames between keyframes
+    int interval;
+    // saved state of the newest keyframe
+    uint8_t key[CHIP8_STATE_SIZE];
+    uint8_t state[CHIP8_STATE_SIZE];
+    // a frame being encoded, runs can take a little more space than what they hold
+    uint8_t encoded[2 * CHIP8_STATE_SIZE];
+};
+
+// keeps at most `frames` frames in at most `bytes` bytes of memory altogether
+struct Chip8Rewind *chip8_rewind_new(int frames, size_t bytes);
+void chip8_rewind_free(struct Chip8Rewind *rewind);
+
+// records the current state of `chip8` as the newest frame
+void chip8_rewind_record(struct Chip8Rewind *rewind, struct Chip8 *chip8);
+// goes back a frame: forgets the newest one and restores `chip8` to the one before it.
+// returns false and leaves `chip8` alone once there is nothing further back
+bool chip8_rewind_step(struct Chip8Rewind *rewind, struct Chip8 *chip8);
+#endif
@@ -0,0 +1,142 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "state.h"
+
+// the part of `struct Chip8` that is saved, everything in front of the caches
+#define STATE_BODY offsetof(struct Chip8, cache)
+
+static_assert(STATE_BODY == CHIP8_STATE_SIZE - CHIP8_STATE_HEADER, "struct Chip8 doesn't match the saved state anymore");
+static_assert(offsetof(struct Chip8, video) == 4160, "struct Chip8 doesn't match the saved state anymore");
+static_assert(offsetof(struct Chip8, dirty_rows) == 4416, "struct Chip8 doesn't match the saved state anymore");
+static_assert(offsetof(struct Chip8, index) == 4420, "struct Chip8 doesn't match the saved state anymore");
+static_assert(offsetof(struct Chip8, sp) == 4426, "struct Chip8 doesn't match the saved state anymore");
+static_assert(offsetof(struct Chip8, halt) == 4427, "struct Chip8 doesn't match the saved state anymore");
+static_assert(offsetof(struct Chip8, rng) == 4428, "struct Chip8 doesn't match the saved state anymore");
+
+// bytes of memory compared at once when restoring into a machine that has decoded blocks
+#define STATE_CHUNK 64
+
+static const uint8_t state_header[CHIP8_STATE_HEADER] = {
+    'C', 'H', '8', 'S', CHIP8_STATE_VERSION & 0xFF, CHIP8_STATE_VERSION >> 8, 0, 0
+};
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define STATE_SWAP
+// turns the numbers of a saved machine from little endian to the host's order and back
+static void state_swap(struct Chip8 *chip8) {
+    for (int i = 0; i < STACKSIZ; i++) {
+        chip8->stack[i] = __builtin_bswap16(chip8->stack[i]);
+    }
+    for (int y = 0; y < VIDEO_H; y++) {
+        chip8->video[y] = __builtin_bswap64(chip8->video[y]);
+    }
+    chip8->index = __builtin_bswap16(chip8->index);
+    chip8->pc = __builtin_bswap16(chip8->pc);
+    chip8->rng = __builtin_bswap32(chip8->rng);
+}
+#endif
+
+size_t chip8_save_state(const struct Chip8 *chip8, uint8_t *buffer, size_t size) {
+    if (size < CHIP8_STATE_SIZE) {
+        return 0;
+    }
+
+#ifdef STATE_SWAP
+    struct Chip8 swapped = *chip8;
+    state_swap(&swapped);
+    chip8 = &swapped;
+#endif
+
+    memcpy(buffer, state_header, CHIP8_STATE_HEADER);
+    uint8_t *body = buffer + CHIP8_STATE_HEADER;
+    memcpy(body, chip8, STATE_BODY);
+    // the same machine always saves to the same bytes
+    memset(body + offsetof(struct Chip8, dirty_rows), 0, sizeof(chip8->dirty_rows));
+    return CHIP8_STATE_SIZE;
+}
+
+// whether the fields the handlers index with or rely on hold values a running machine can have
+static bool state_valid(const uint8_t *body) {
+    const uint8_t sp = body[offsetof(struct Chip8, sp)];
+    const uint8_t halt = body[offsetof(struct Chip8, halt)];
+    const uint8_t *rng = body + offsetof(struct Chip8, rng);
+    const uint8_t wait = halt & ~CHIP8_HALT_KEY;
+    return sp < STACKSIZ
+        && (halt == 0 || halt == CHIP8_HALT_PRESS || wait == CHIP8_HALT_RELEASE || wait == CHIP8_HALT_DONE)
+        // xorshift never leaves 0
+        && (rng[0] | rng[1] | rng[2] | rng[3]);
+}
+
+bool chip8_load_state(struct Chip8 *chip8, const uint8_t *buffer, size_t size) {
+    if (size < CHIP8_STATE_SIZE || memcmp(buffer, state_header, CHIP8_STATE_HEADER)) {
+        return false;
+    }
+
+    const uint8_t *body = buffer + CHIP8_STATE_HEADER;
+    if (!state_valid(body)) {
+        return false;
+    }
+    // only the code that differs from the saved one has to be decoded again
+    if (chip8->cache) {
+        for (int addr = 0; addr < MEMORYSIZ; addr += STATE_CHUNK) {
+            if (memcmp(chip8->memory + addr, body + addr, STATE_CHUNK)) {
+                chip8_invalidate(chip8, addr, STATE_CHUNK);
+            }
+        }
+    }
+
+    memcpy(chip8, body, STATE_BODY);
+#ifdef STATE_SWAP
+    state_swap(chip8);
+#endif
+    // whatever was shown before has nothing to do with this screen
+    chip8->dirty_rows = UINT32_MAX;
+    chip8->video_hash = chip8_video_hash(chip8->video);
+    // isn't saved, the tone goes on if the timer still runs (only a beep's last frame is told apart by it)
+    chip8->sounding = chip8->sound_timer > 0;
+    return true;
+}
+
+const char *chip8_state_diff(const struct Chip8 *a, const struct Chip8 *b) {
+    if (memcmp(a->registers, b->registers, sizeof(a->registers))) return "registers";
+    if (a->index != b->index) return "I";
+    if (MEMORY_ADDR(a->pc) != MEMORY_ADDR(b->pc)) return "PC";
+    if (a->sp != b->sp) return "SP";
+    if (memcmp(a->stack, b->stack, sizeof(a->stack))) return "stack";
+    if (a->delay_timer != b->delay_timer || a->sound_timer != b->sound_timer) return "timers";
+    if (memcmp(a->memory, b->memory, sizeof(a->memory))) return "memory";
+    if (memcmp(a->video, b->video, sizeof(a->video))) return "video";
+    if (a->halt != b->halt) return "halt";
+    if (a->rng != b->rng) return "RNG";
+    return NULL;
+}
+
+void chip8_save_state_file(const struct Chip8 *chip8, const char *restrict filename) {
+    uint8_t buffer[CHIP8_STATE_SIZE];
+    chip8_save_state(chip8, buffer, sizeof(buffer));
+
+    FILE *file = fopen(filename, "wb");
+    if (!file || fwrite(buffer, sizeof(buffer), 1, file) != 1) {
+        fputs("Error: Could not write the state.", stderr);
+        exit(1);
+    }
+    fclose(file);
+}
+
+void chip8_load_state_file(struct Chip8 *chip8, const char *restrict filename) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        fputs("Error: Could not open the state.", stderr);
+        exit(1);
+    }
+
+    uint8_t buffer[CHIP8_STATE_SIZE];
+    const size_t size = fread(buffer, 1, sizeof(buffer), file);
+    fclose(file);
+    if (!chip8_load_state(chip8, buffer, size)) {
+        fputs("Error: Not a state saved by this version.", stderr);
+        exit(1);
+    }
+}
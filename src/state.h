@@ -0,0 +1,44 @@
+#ifndef CHIP8_STATE
+#define CHIP8_STATE
+#include <stddef.h>
+#include "cpu.h"
+
+// changes whenever the layout below does, states of other versions are refused
+#define CHIP8_STATE_VERSION 3
+
+// A saved state is a header of 8 bytes, "CH8S", the version as a little endian 16 bit
+// number and 2 zero bytes, followed by the machine itself:
+//
+//     offset  size
+//          0  4096  memory
+//       4096    32  stack, 16 bit words
+//       4128    16  registers V0 to VF
+//       4144    16  keypad, 1 for every key held down
+//       4160   256  video, 64 bit words as in `struct Chip8.video`
+//       4416     4  (unused)
+//       4420     2  I
+//       4422     2  PC
+//       4424     1  sound timer
+//       4425     1  delay timer
+//       4426     1  SP
+//       4427     1  what Fx0A waits for, as in `struct Chip8.halt`
+//       4428     4  RNG state
+//
+// with every number little endian. This is the layout of `struct Chip8` up to its
+// caches, so on little endian hosts saving and restoring a state are a copy each.
+#define CHIP8_STATE_HEADER 8
+#define CHIP8_STATE_SIZE (CHIP8_STATE_HEADER + 4432)
+
+// writes the state of `chip8` to `buffer`, returns its size or 0 if it didn't fit in `size` bytes
+size_t chip8_save_state(const struct Chip8 *chip8, uint8_t *buffer, size_t size);
+// restores `chip8` to a state saved with chip8_save_state, keeping its cache and JIT.
+// returns false and leaves `chip8` alone if `buffer` doesn't hold a state of this version,
+// or holds one with an SP, RNG state or Fx0A wait no machine could have been in
+bool chip8_load_state(struct Chip8 *chip8, const uint8_t *buffer, size_t size);
+
+// returns the name of the first part of the saved state where `a` and `b` differ, NULL if they're the same
+const char *chip8_state_diff(const struct Chip8 *a, const struct Chip8 *b);
+
+void chip8_save_state_file(const struct Chip8 *chip8, const char *restrict filename);
+void chip8_load_state_file(struct Chip8 *chip8, const char *restrict filename);
+#endif
@@ -0,0 +1,339 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+#include "cache.h"
+#include "profile.h"
+
+static_assert(TRACE_CHUNK >= BLOCKSIZ * TRACE_RECORD_MAX, "a chunk must hold the records of a whole block");
+
+static const uint8_t trace_header[CHIP8_TRACE_HEADER] = {
+    'C', 'H', '8', 'T', CHIP8_TRACE_VERSION & 0xFF, CHIP8_TRACE_VERSION >> 8, 0, 0
+};
+
+// wakes whoever waits on `cond`. the lock is taken so the signal can't come between their check and their wait
+static void chip8_trace_signal(struct Chip8Trace *trace, cnd_t *cond) {
+    mtx_lock(&trace->lock);
+    cnd_signal(cond);
+    mtx_unlock(&trace->lock);
+}
+
+// writes the chunks handed over until the trace is closed and they're all out
+static int chip8_trace_write(void *data) {
+    struct Chip8Trace *trace = data;
+    for (;;) {
+        const uint32_t tail = atomic_load_explicit(&trace->tail, memory_order_relaxed);
+        // closing is only set after the last chunk was handed over, so it's read before `head`
+        const bool closing = atomic_load_explicit(&trace->closing, memory_order_acquire);
+        const uint32_t head = atomic_load_explicit(&trace->head, memory_order_acquire);
+        if (tail == head) {
+            if (closing) {
+                return 0;
+            }
+            mtx_lock(&trace->lock);
+            while (atomic_load_explicit(&trace->head, memory_order_acquire) == tail
+                   && !atomic_load_explicit(&trace->closing, memory_order_acquire)) {
+                cnd_wait(&trace->handed, &trace->lock);
+            }
+            mtx_unlock(&trace->lock);
+            continue;
+        }
+
+        const int chunk = tail % TRACE_CHUNKS;
+        if (fwrite(trace->chunks[chunk], 1, trace->sizes[chunk], trace->file) != trace->sizes[chunk]) {
+            fputs("Error: Could not write the trace.", stderr);
+            exit(1);
+        }
+        // the chunk is the machine's to fill again
+        atomic_store_explicit(&trace->tail, tail + 1, memory_order_release);
+        chip8_trace_signal(trace, &trace->written);
+    }
+}
+
+struct Chip8Trace *chip8_trace_new(const char *restrict filename) {
+    struct Chip8Trace *trace = calloc(1, sizeof(struct Chip8Trace));
+    if (!trace) {
+        fputs("Error: Could not allocate the trace.", stderr);
+        exit(1);
+    }
+    for (int i = 0; i < TRACE_CHUNKS; i++) {
+        trace->chunks[i] = malloc(TRACE_CHUNK);
+        if (!trace->chunks[i]) {
+            fputs("Error: Could not allocate the trace.", stderr);
+            exit(1);
+        }
+    }
+
+    trace->file = fopen(filename, "wb");
+    if (!trace->file || fwrite(trace_header, CHIP8_TRACE_HEADER, 1, trace->file) != 1) {
+        fputs("Error: Could not create the trace.", stderr);
+        exit(1);
+    }
+
+    trace->chunk = trace->chunks[0];
+    // nothing comes after an address of 0xFFFF, so the first record always holds its address
+    trace->state.next = 0xFFFF;
+    atomic_init(&trace->closing, false);
+    atomic_init(&trace->head, 0);
+    atomic_init(&trace->tail, 0);
+    if (mtx_init(&trace->lock, mtx_plain) != thrd_success || cnd_init(&trace->handed) != thrd_success
+        || cnd_init(&trace->written) != thrd_success || thrd_create(&trace->writer, chip8_trace_write, trace) != thrd_success) {
+        fputs("Error: Could not start the trace writer.", stderr);
+        exit(1);
+    }
+    return trace;
+}
+
+// hands the chunk being filled to the writer and waits until the next one is free
+static void chip8_trace_flush(struct Chip8Trace *trace) {
+    const uint32_t head = atomic_load_explicit(&trace->head, memory_order_relaxed);
+    trace->sizes[head % TRACE_CHUNKS] = trace->used;
+    atomic_store_explicit(&trace->head, head + 1, memory_order_release);
+    chip8_trace_signal(trace, &trace->handed);
+    trace->chunk = trace->chunks[(head + 1) % TRACE_CHUNKS];
+    trace->used = 0;
+
+    if (head + 1 - atomic_load_explicit(&trace->tail, memory_order_acquire) == TRACE_CHUNKS) {
+        mtx_lock(&trace->lock);
+        while (head + 1 - atomic_load_explicit(&trace->tail, memory_order_acquire) == TRACE_CHUNKS) {
+            cnd_wait(&trace->written, &trace->lock);
+        }
+        mtx_unlock(&trace->lock);
+    }
+}
+
+void chip8_trace_free(struct Chip8Trace *trace) {
+    if (!trace) {
+        return;
+    }
+
+    if (trace->used) {
+        chip8_trace_flush(trace);
+    }
+    atomic_store_explicit(&trace->closing, true, memory_order_release);
+    chip8_trace_signal(trace, &trace->handed);
+    thrd_join(trace->writer, NULL);
+    cnd_destroy(&trace->written);
+    cnd_destroy(&trace->handed);
+    mtx_destroy(&trace->lock);
+
+    if (fclose(trace->file) != 0) {
+        fputs("Error: Could not write the trace.", stderr);
+        exit(1);
+    }
+    for (int i = 0; i < TRACE_CHUNKS; i++) {
+        free(trace->chunks[i]);
+    }
+    free(trace);
+}
+
+// the instruction is compared in full, as if it could have changed any register, I and the timers
+#define TRACE_ALL 0xFF
+
+// encodes the record of the instruction `opcode` at `pc` into `record`, comparing only what `flags` say
+// it may have changed, and returns where the next record goes. only the `first` instruction of a block
+// can have been jumped to, the others follow the one before. always inlined, so the loop over a block
+// keeps its pointers in registers instead of making a call for every instruction
+__attribute__((always_inline))
+static inline uint8_t *chip8_trace_record(struct Chip8TraceState *state, const struct Chip8 *chip8, uint8_t *record,
+                                          uint16_t pc, uint16_t opcode, uint8_t flags, bool first) {
+    uint8_t *p = record + 1;
+    // what the record holds
+    uint8_t changed = 0;
+
+    if (first && pc != state->next) {
+        changed |= CHIP8_TRACE_JUMP;
+        *p++ = pc;
+        *p++ = pc >> 8;
+    }
+
+    if (opcode != state->opcodes[pc]) {
+        changed |= CHIP8_TRACE_OPCODE;
+        *p++ = opcode;
+        *p++ = opcode >> 8;
+        state->opcodes[pc] = opcode;
+    }
+
+    // only the registers the instruction may have written are compared, a byte at a time:
+    // the handler just stored one of them, and a wider load over that store would stall
+    uint16_t written = 0;
+    if (flags & CHIP8_INST_VX) {
+        const int x = opcode >> 8 & 0xF;
+        written |= (chip8->registers[x] != state->registers[x]) << x;
+    }
+    if (flags & CHIP8_INST_VF) {
+        written |= (chip8->registers[VF] != state->registers[VF]) << VF;
+    }
+    if (flags & CHIP8_INST_VREGS) {
+        const int last = flags == TRACE_ALL ? VF : opcode >> 8 & 0xF;
+        for (int r = 0; r <= last; r++) {
+            written |= (chip8->registers[r] != state->registers[r]) << r;
+        }
+    }
+    if (written) {
+        if (!(written & (written - 1))) {
+            const int r = __builtin_ctz(written);
+            changed |= CHIP8_TRACE_REG;
+            *p++ = r;
+            *p++ = chip8->registers[r];
+            state->registers[r] = chip8->registers[r];
+        } else {
+            changed |= CHIP8_TRACE_REGS;
+            *p++ = written;
+            *p++ = written >> 8;
+            for (uint16_t left = written; left; left &= left - 1) {
+                const int r = __builtin_ctz(left);
+                *p++ = chip8->registers[r];
+                state->registers[r] = chip8->registers[r];
+            }
+        }
+    }
+
+    if (flags & CHIP8_INST_INDEX && chip8->index != state->index) {
+        changed |= CHIP8_TRACE_INDEX;
+        *p++ = chip8->index;
+        *p++ = chip8->index >> 8;
+        state->index = chip8->index;
+    }
+    if (flags & CHIP8_INST_TIMERS) {
+        if (chip8->delay_timer != state->delay_timer) {
+            changed |= CHIP8_TRACE_DT;
+            *p++ = chip8->delay_timer;
+            state->delay_timer = chip8->delay_timer;
+        }
+        if (chip8->sound_timer != state->sound_timer) {
+            changed |= CHIP8_TRACE_ST;
+            *p++ = chip8->sound_timer;
+            state->sound_timer = chip8->sound_timer;
+        }
+    }
+
+    *record = changed;
+    return p;
+}
+
+// hands the chunk to the writer first if `count` more records might not fit in it
+static void chip8_trace_reserve(struct Chip8Trace *trace, int count) {
+    if (trace->used > TRACE_CHUNK - (size_t)count * TRACE_RECORD_MAX) {
+        chip8_trace_flush(trace);
+    }
+}
+
+void chip8_trace_exec(struct Chip8Trace *trace, const struct Chip8 *chip8, uint16_t pc, uint16_t opcode) {
+    chip8_trace_reserve(trace, 1);
+    uint8_t *const record = trace->chunk + trace->used;
+    trace->used += chip8_trace_record(&trace->state, chip8, record, pc, opcode, TRACE_ALL, true) - record;
+    trace->state.next = pc + 2;
+    trace->instructions++;
+}
+
+void chip8_trace_block(struct Chip8Trace *trace, struct Chip8 *chip8, const struct Chip8Inst *block, int len) {
+    chip8_trace_reserve(trace, len);
+    uint8_t *const start = trace->chunk + trace->used;
+    uint8_t *p = start;
+    uint16_t pc = chip8->pc;
+    for (int i = 0; i < len; i++) {
+        const struct Chip8Inst *inst = &block[2 * i];
+        pc = chip8->pc;
+        const uint16_t opcode = chip8->memory[pc] << 8 | chip8->memory[MEMORY_ADDR(pc + 1)];
+        chip8->pc += 2;
+        CHIP8_PROFILE_EXEC(chip8, inst);
+        if (i == 0) {
+            // the timers tick in between blocks, so the first instruction of one also looks at them
+            p = chip8_trace_record(&trace->state, chip8, p, pc, opcode, inst->flags | CHIP8_INST_TIMERS, true);
+        } else {
+            p = chip8_trace_record(&trace->state, chip8, p, pc, opcode, inst->flags, false);
+        }
+    }
+    trace->state.next = pc + 2;
+    trace->used += p - start;
+    trace->instructions += len;
+}
+
+struct Chip8TraceReader *chip8_trace_open(const char *restrict filename) {
+    struct Chip8TraceReader *reader = calloc(1, sizeof(struct Chip8TraceReader));
+    if (!reader) {
+        fputs("Error: Could not allocate the trace reader.", stderr);
+        exit(1);
+    }
+
+    uint8_t header[CHIP8_TRACE_HEADER];
+    reader->file = fopen(filename, "rb");
+    if (!reader->file || fread(header, CHIP8_TRACE_HEADER, 1, reader->file) != 1
+        || memcmp(header, trace_header, CHIP8_TRACE_HEADER)) {
+        fputs("Error: Could not read the trace.", stderr);
+        exit(1);
+    }
+    reader->state.next = 0xFFFF;
+    return reader;
+}
+
+void chip8_trace_close(struct Chip8TraceReader *reader) {
+    if (!reader) {
+        return;
+    }
+    fclose(reader->file);
+    free(reader);
+}
+
+// reads a little endian number of `size` bytes, exits if the trace ends in the middle of a record
+static uint16_t chip8_trace_get(struct Chip8TraceReader *reader, int size) {
+    uint16_t value = 0;
+    for (int i = 0; i < size; i++) {
+        const int byte = getc(reader->file);
+        if (byte == EOF) {
+            fputs("Error: The trace ends in the middle of an instruction.", stderr);
+            exit(1);
+        }
+        value |= byte << (8 * i);
+    }
+    return value;
+}
+
+bool chip8_trace_read(struct Chip8TraceReader *reader, struct Chip8TraceRecord *record) {
+    struct Chip8TraceState *state = &reader->state;
+    const int flags = getc(reader->file);
+    if (flags == EOF) {
+        return false;
+    }
+
+    const uint16_t pc = flags & CHIP8_TRACE_JUMP ? chip8_trace_get(reader, 2) : state->next;
+    state->next = pc + 2;
+    if (flags & CHIP8_TRACE_OPCODE) {
+        state->opcodes[MEMORY_ADDR(pc)] = chip8_trace_get(reader, 2);
+    }
+
+    uint16_t written = 0;
+    if (flags & CHIP8_TRACE_REG) {
+        written = 1u << (chip8_trace_get(reader, 1) % REGISTERSIZ);
+    } else if (flags & CHIP8_TRACE_REGS) {
+        written = chip8_trace_get(reader, 2);
+    }
+    for (int r = 0; r < REGISTERSIZ; r++) {
+        if (written & 1u << r) {
+            state->registers[r] = chip8_trace_get(reader, 1);
+        }
+    }
+
+    if (flags & CHIP8_TRACE_INDEX) {
+        state->index = chip8_trace_get(reader, 2);
+    }
+    if (flags & CHIP8_TRACE_DT) {
+        state->delay_timer = chip8_trace_get(reader, 1);
+    }
+    if (flags & CHIP8_TRACE_ST) {
+        state->sound_timer = chip8_trace_get(reader, 1);
+    }
+
+    *record = (struct Chip8TraceRecord) {
+        .pc = pc,
+        .opcode = state->opcodes[MEMORY_ADDR(pc)],
+        .flags = flags,
+        .written = written,
+        .index = state->index,
+        .delay_timer = state->delay_timer,
+        .sound_timer = state->sound_timer,
+    };
+    memcpy(record->registers, state->registers, REGISTERSIZ);
+    return true;
+}
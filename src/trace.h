@@ -0,0 +1,119 @@
+#ifndef CHIP8_TRACE
+#define CHIP8_TRACE
+#include <stdatomic.h>
+#include <stdio.h>
+#include <threads.h>
+#include "cpu.h"
+
+// changes whenever the format below does
+#define CHIP8_TRACE_VERSION 1
+
+// An execution trace is a header of 8 bytes, "CH8T", the version as a little endian
+// 16 bit number and 2 zero bytes, followed by a record for every instruction run.
+// A record starts with a byte of the flags below and then holds, in this order, only
+// what the flags say changed since the previous record (or since a machine with
+// everything at 0, for the first one), every number little endian:
+//
+//     flag                 size
+//     CHIP8_TRACE_JUMP        2  address of the instruction, when it isn't the one after the previous
+//     CHIP8_TRACE_OPCODE      2  the instruction, when it isn't what was last run at its address
+//     CHIP8_TRACE_REG         2  the register written and its value, when a single one was
+//     CHIP8_TRACE_REGS     2+n  a mask of the registers written, then their values, when several were
+//     CHIP8_TRACE_INDEX       2  I
+//     CHIP8_TRACE_DT          1  delay timer
+//     CHIP8_TRACE_ST          1  sound timer
+//
+// Registers, I and timers are as the instruction left them, so the first record after a frame
+// also holds the timers ticking. A loop running in place mostly takes a byte per instruction.
+#define CHIP8_TRACE_HEADER 8
+#define CHIP8_TRACE_JUMP 0x01
+#define CHIP8_TRACE_OPCODE 0x02
+#define CHIP8_TRACE_REG 0x04
+#define CHIP8_TRACE_REGS 0x08
+#define CHIP8_TRACE_INDEX 0x10
+#define CHIP8_TRACE_DT 0x20
+#define CHIP8_TRACE_ST 0x40
+
+// the most a record takes
+#define TRACE_RECORD_MAX (1 + 2 + 2 + 2 + REGISTERSIZ + 2 + 1 + 1)
+// records are gathered in chunks of this many bytes, and this many chunks are filled or being written at once
+#define TRACE_CHUNK (1 << 20)
+#define TRACE_CHUNKS 8
+
+// what the previous record left the machine at, which the next one only holds changes to
+struct Chip8TraceState {
+    // address after the previous instruction's
+    uint16_t next;
+    uint16_t index;
+    uint8_t registers[REGISTERSIZ];
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+    // the instruction last run at every address
+    uint16_t opcodes[MEMORYSIZ];
+};
+
+// Records every instruction a machine runs while its `trace` points at one of these.
+// The machine's thread encodes records into a chunk of its own and hands full chunks
+// to a writer thread through a ring: the machine only moves `head` and the writer `tail`,
+// and a chunk is the machine's to fill again once `tail` is past it. Either side only
+// takes `lock` to sleep on a condition when there's nothing for it to do, or to wake the
+// other, once per chunk. The machine only waits when the writer is a whole ring behind.
+struct Chip8Trace {
+    struct Chip8TraceState state;
+    // the chunk at `head`, which is being filled, and the bytes of it that are
+    uint8_t *chunk;
+    size_t used;
+    // bytes of every chunk handed to the writer
+    size_t sizes[TRACE_CHUNKS];
+    uint8_t *chunks[TRACE_CHUNKS];
+    // instructions recorded so far
+    uint64_t instructions;
+    // only touched by the writer once it started
+    FILE *file;
+    thrd_t writer;
+    mtx_t lock;
+    // signalled when a chunk was handed to the writer (or the trace is closing), and when it was written out
+    cnd_t handed;
+    cnd_t written;
+    // set once the last chunk was handed over, so the writer stops when it's done with it
+    _Atomic(bool) closing;
+    _Alignas(64) _Atomic(uint32_t) head;
+    _Alignas(64) _Atomic(uint32_t) tail;
+};
+
+// creates `filename` and starts the thread writing to it, exits on errors
+struct Chip8Trace *chip8_trace_new(const char *restrict filename);
+// writes out every record left, stops the writer and closes the file
+void chip8_trace_free(struct Chip8Trace *trace);
+
+// records the instruction `opcode` at `pc` that `chip8` just ran
+void chip8_trace_exec(struct Chip8Trace *trace, const struct Chip8 *chip8, uint16_t pc, uint16_t opcode);
+// runs the `len` instructions of a cached block from the PC on and records them, looking only at what
+// each of them may have changed (from its CHIP8_INST_ flags) after the first
+void chip8_trace_block(struct Chip8Trace *trace, struct Chip8 *chip8, const struct Chip8Inst *block, int len);
+
+// an instruction read back from a trace, with the state it left the machine in
+struct Chip8TraceRecord {
+    uint16_t pc;
+    uint16_t opcode;
+    uint8_t flags;
+    // a bit for every register the instruction wrote
+    uint16_t written;
+    uint16_t index;
+    uint8_t registers[REGISTERSIZ];
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+};
+
+// reads a trace back one record at a time
+struct Chip8TraceReader {
+    struct Chip8TraceState state;
+    FILE *file;
+};
+
+// opens a trace, exits if it isn't one
+struct Chip8TraceReader *chip8_trace_open(const char *restrict filename);
+void chip8_trace_close(struct Chip8TraceReader *reader);
+// reads the next record, returns false at the end of the trace
+bool chip8_trace_read(struct Chip8TraceReader *reader, struct Chip8TraceRecord *record);
+#endif
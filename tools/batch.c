@@ -0,0 +1,240 @@
+// needed for sysconf
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <time.h>
+#include <unistd.h>
+#include "cpu.h"
+#include "cache.h"
+#include "jit.h"
+
+#define MAX_THREADS 256
+
+struct Job {
+    const char *rom;
+    long long frames;
+    // results, or why the ROM couldn't be run
+    const char *error;
+    long long instructions;
+    uint64_t hash;
+    uint16_t pc;
+};
+
+// Every worker pops jobs off the back of its own deque, and once that's empty steals
+// them off the front of the others'. Jobs are whole ROMs, so a lock per deque is cheap
+// next to running one, and stealing keeps all cores busy when some ROMs run much longer.
+struct Deque {
+    mtx_t lock;
+    int *jobs;
+    int head;
+    int tail;
+};
+
+struct Worker {
+    struct Deque deque;
+    thrd_t thread;
+    struct Chip8Cache *cache;
+    struct Chip8Jit *jit;
+};
+
+static struct Job *jobs;
+static int job_count;
+static struct Worker workers[MAX_THREADS];
+static int worker_count;
+static int ipf = IPF;
+static bool use_jit = false;
+
+static void usage(void) {
+    fputs("Usage: chip8-batch [-j] [-i instructions_per_frame] [-t threads] [-f frames] [-l list] <rom[:frames]>...\n", stderr);
+    exit(1);
+}
+
+// -1 once there's nothing left anywhere
+static int chip8_take_job(int self) {
+    struct Deque *own = &workers[self].deque;
+    int job = -1;
+    mtx_lock(&own->lock);
+    if (own->head < own->tail) {
+        job = own->jobs[--own->tail];
+    }
+    mtx_unlock(&own->lock);
+
+    for (int i = 1; job < 0 && i < worker_count; i++) {
+        struct Deque *victim = &workers[(self + i) % worker_count].deque;
+        mtx_lock(&victim->lock);
+        if (victim->head < victim->tail) {
+            job = victim->jobs[victim->head++];
+        }
+        mtx_unlock(&victim->lock);
+    }
+
+    return job;
+}
+
+static void chip8_run_job(struct Worker *worker, struct Job *job) {
+    struct Chip8 chip8 = chip8_new();
+    chip8.cache = worker->cache;
+    chip8.jit = worker->jit;
+    // the cache and native code are reused from the previous ROM this worker ran
+    chip8_invalidate(&chip8, 0, MEMORYSIZ);
+    // a ROM that can't be loaded only fails its own line, not the whole batch
+    job->error = chip8_try_load_rom(&chip8, job->rom);
+    if (job->error) {
+        return;
+    }
+
+    long long done = 0;
+    for (long long frame = 0; frame < job->frames; frame++) {
+        done += chip8_run_frame(&chip8, ipf);
+    }
+
+    job->instructions = done;
+    job->pc = chip8.pc;
+    job->hash = chip8.video_hash;
+}
+
+static int chip8_work(void *data) {
+    struct Worker *worker = data;
+    const int self = worker - workers;
+
+    for (int job; (job = chip8_take_job(self)) >= 0;) {
+        chip8_run_job(worker, &jobs[job]);
+    }
+    return 0;
+}
+
+// `rom` or `rom:frames`
+static void chip8_add_job(char *arg, long long frames) {
+    char *colon = strrchr(arg, ':');
+    if (colon && colon[1] && strspn(colon + 1, "0123456789") == strlen(colon + 1)) {
+        *colon = '\0';
+        frames = atoll(colon + 1);
+    }
+
+    jobs = realloc(jobs, (job_count + 1) * sizeof(struct Job));
+    if (!jobs) {
+        fputs("Error: Could not allocate the jobs.", stderr);
+        exit(1);
+    }
+    jobs[job_count++] = (struct Job) { .rom = arg, .frames = frames };
+}
+
+// one `rom [frames]` per line
+static void chip8_add_list(const char *filename, long long frames) {
+    FILE *list = strcmp(filename, "-") == 0 ? stdin : fopen(filename, "r");
+    if (!list) {
+        fputs("Error: Could not open the ROM list.", stderr);
+        exit(1);
+    }
+
+    char line[4096];
+    while (fgets(line, sizeof(line), list)) {
+        char *rom = strtok(line, " \t\r\n");
+        if (!rom) {
+            continue;
+        }
+        const char *count = strtok(NULL, " \t\r\n");
+        chip8_add_job(strdup(rom), count ? atoll(count) : frames);
+    }
+
+    if (list != stdin) {
+        fclose(list);
+    }
+}
+
+// Runs every ROM for its amount of frames with no display, spread over all cores,
+// and prints the screen hash, PC and instruction count each one ends up with.
+int main(int argc, char **argv) {
+    long long frames = FRAMERATE * 60;
+    worker_count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0) {
+            use_jit = true;
+        } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            ipf = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            worker_count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            frames = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            chip8_add_list(argv[++i], frames);
+        } else if (argv[i][0] == '-') {
+            usage();
+        } else {
+            chip8_add_job(argv[i], frames);
+        }
+    }
+
+    if (!job_count || ipf <= 0) {
+        usage();
+    }
+    if (worker_count < 1) {
+        worker_count = 1;
+    }
+    if (worker_count > MAX_THREADS) {
+        worker_count = MAX_THREADS;
+    }
+    if (worker_count > job_count) {
+        worker_count = job_count;
+    }
+
+    // jobs are dealt out round robin, stealing evens out whatever that gets wrong
+    for (int i = 0; i < worker_count; i++) {
+        struct Worker *worker = &workers[i];
+        mtx_init(&worker->deque.lock, mtx_plain);
+        worker->deque.jobs = malloc(job_count * sizeof(int));
+        if (!worker->deque.jobs) {
+            fputs("Error: Could not allocate the jobs.", stderr);
+            exit(1);
+        }
+        worker->cache = chip8_cache_new();
+        worker->jit = use_jit ? chip8_jit_new() : NULL;
+    }
+    for (int i = 0; i < job_count; i++) {
+        struct Deque *deque = &workers[i % worker_count].deque;
+        deque->jobs[deque->tail++] = i;
+    }
+
+    struct timespec start, end;
+    timespec_get(&start, TIME_UTC);
+
+    for (int i = 0; i < worker_count; i++) {
+        if (thrd_create(&workers[i].thread, chip8_work, &workers[i]) != thrd_success) {
+            fputs("Error: Could not start a worker thread.", stderr);
+            exit(1);
+        }
+    }
+    for (int i = 0; i < worker_count; i++) {
+        thrd_join(workers[i].thread, NULL);
+    }
+
+    timespec_get(&end, TIME_UTC);
+    const double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    long long total = 0;
+    int failed = 0;
+    for (int i = 0; i < job_count; i++) {
+        const struct Job *job = &jobs[i];
+        if (job->error) {
+            printf("Error: %s: %s\n", job->rom, job->error);
+            failed++;
+            continue;
+        }
+        printf("%016llx 0x%03X %lld %s\n", (unsigned long long)job->hash, job->pc, job->instructions, job->rom);
+        total += job->instructions;
+    }
+    fprintf(stderr, "%d ROMs on %d threads in %.3f seconds, %.1f MIPS\n",
+            job_count, worker_count, seconds, seconds > 0 ? total / seconds / 1e6 : 0.0);
+
+    for (int i = 0; i < worker_count; i++) {
+        mtx_destroy(&workers[i].deque.lock);
+        free(workers[i].deque.jobs);
+        chip8_jit_free(workers[i].jit);
+        chip8_cache_free(workers[i].cache);
+    }
+    free(jobs);
+    return failed > 0;
+}
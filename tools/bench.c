@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cpu.h"
+#include "cache.h"
+#include "jit.h"
+#include "frame.h"
+#include "opcode.h"
+
+// where the synthetic ROMs keep their data, well away from their code
+#define DATAADDR 0x300
+
+struct BenchRom {
+    const char *name;
+    const uint16_t *code;
+    size_t len;
+};
+
+// arithmetic and logic on registers in a tight loop
+static const uint16_t bench_alu[] = {
+    0x6000, // LD V0, 0x00
+    0x6100, // LD V1, 0x00
+    0x7001, // ADD V0, 0x01
+    0x8104, // ADD V1, V0
+    0x8213, // XOR V2, V1
+    0x8321, // OR V3, V2
+    0x8432, // AND V4, V3
+    0x8545, // SUB V5, V4
+    0x8656, // SHR V6, V5
+    0x3000, // SE V0, 0x00
+    0x1204, // JP 0x204
+    0x1200, // JP 0x200
+};
+
+// tall sprites drawn all over the screen
+static const uint16_t bench_sprites[] = {
+    0xA300, // LD I, 0x300
+    0x6000, // LD V0, 0x00
+    0x6100, // LD V1, 0x00
+    0xD01F, // DRW V0, V1, 15
+    0x7003, // ADD V0, 0x03
+    0x7105, // ADD V1, 0x05
+    0x1206, // JP 0x206
+};
+
+// subroutines three deep
+static const uint16_t bench_calls[] = {
+    0x2206, // CALL 0x206
+    0x1200, // JP 0x200
+    0x0000,
+    0x220C, // CALL 0x20C
+    0x00EE, // RET
+    0x0000,
+    0x2212, // CALL 0x212
+    0x00EE, // RET
+    0x0000,
+    0x7001, // ADD V0, 0x01
+    0x00EE, // RET
+};
+
+// BCD and register dumps and loads, memory writes every few instructions
+static const uint16_t bench_memory[] = {
+    0xA300, // LD I, 0x300
+    0x7001, // ADD V0, 0x01
+    0xF033, // LD B, V0
+    0xFF55, // LD [I], VF
+    0xFF65, // LD VF, [I]
+    0x1202, // JP 0x202
+};
+
+static const struct BenchRom bench_roms[] = {
+    { "alu", bench_alu, sizeof(bench_alu) / sizeof(bench_alu[0]) },
+    { "sprites", bench_sprites, sizeof(bench_sprites) / sizeof(bench_sprites[0]) },
+    { "calls", bench_calls, sizeof(bench_calls) / sizeof(bench_calls[0]) },
+    { "memory", bench_memory, sizeof(bench_memory) / sizeof(bench_memory[0]) },
+};
+
+// instructions run between looking at the clock
+#define BENCH_CHUNK 100000
+
+static double seconds = 0.5;
+
+static double bench_now(void) {
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void bench_load(struct Chip8 *chip8, const struct BenchRom *rom) {
+    for (size_t i = 0; i < rom->len; i++) {
+        chip8->memory[INSTADDR + 2 * i] = rom->code[i] >> 8;
+        chip8->memory[INSTADDR + 2 * i + 1] = rom->code[i] & 0xFF;
+    }
+    // something to draw
+    for (int i = 0; i < 16; i++) {
+        chip8->memory[DATAADDR + i] = 0xA5 ^ (i * 0x11);
+    }
+    chip8_invalidate(chip8, 0, MEMORYSIZ);
+}
+
+// runs `rom` for about `seconds` and prints how fast it went
+static void bench_rom(const struct BenchRom *rom, const char *mode, struct Chip8Cache *cache, struct Chip8Jit *jit, bool last) {
+    struct Chip8 chip8 = chip8_new();
+    chip8.cache = cache;
+    chip8.jit = jit;
+    bench_load(&chip8, rom);
+
+    // the first run translates the blocks, it isn't what's measured
+    chip8_run(&chip8, BENCH_CHUNK);
+
+    long long done = 0;
+    const double start = bench_now();
+    double elapsed;
+    do {
+        done += chip8_run(&chip8, BENCH_CHUNK);
+        elapsed = bench_now() - start;
+    } while (elapsed < seconds);
+
+    printf("    {\"rom\": \"%s\", \"mode\": \"%s\", \"instructions\": %lld, \"seconds\": %.6f, \"instructions_per_second\": %.0f}%s\n",
+           rom->name, mode, done, elapsed, done / elapsed, last ? "" : ",");
+}
+
+// DRW on its own, a 15 row sprite at every position
+static double bench_dxyn(void) {
+    struct Chip8 chip8 = chip8_new();
+    bench_load(&chip8, &bench_roms[1]);
+    chip8.index = DATAADDR;
+    const struct Chip8Inst draw = chip8_decode(0xD01F);
+
+    long long done = 0;
+    const double start = bench_now();
+    double elapsed;
+    do {
+        for (int i = 0; i < BENCH_CHUNK; i++) {
+            chip8.registers[V0] = i;
+            chip8.registers[V1] = i >> 6;
+            chip8_op_dxyn(&chip8, &draw);
+        }
+        done += BENCH_CHUNK;
+        elapsed = bench_now() - start;
+    } while (elapsed < seconds);
+
+    return elapsed / done * 1e9;
+}
+
+// what the frontend does with a frame before handing it to SDL: publishing it,
+// taking it on the other side and turning every row of it into pixels
+static double bench_render(void) {
+    struct Chip8 chip8 = chip8_new();
+    for (int y = 0; y < VIDEO_H; y++) {
+        chip8.video[y] = 0x0123456789ABCDEF * (y + 1);
+    }
+    static struct Chip8Frames frames;
+    chip8_frames_init(&frames);
+    static uint32_t pixels[VIDEO_W * VIDEO_H];
+
+    long long done = 0;
+    const double start = bench_now();
+    double elapsed;
+    do {
+        for (int i = 0; i < BENCH_CHUNK / 100; i++) {
+            chip8.video[i % VIDEO_H] ^= 1;
+            chip8.dirty_rows = UINT32_MAX;
+            chip8_frames_publish(&frames, &chip8);
+            const struct Chip8Frame *frame = chip8_frames_take(&frames);
+            chip8_frame_pixels(frame->video, 0, VIDEO_H - 1, 0xFFFFFFFF, 0xFF000000, pixels, VIDEO_W * sizeof(uint32_t));
+        }
+        done += BENCH_CHUNK / 100;
+        elapsed = bench_now() - start;
+    } while (elapsed < seconds);
+
+    return elapsed / done * 1e9;
+}
+
+// Runs synthetic ROMs that each stress one part of the emulator, on the interpreter
+// with and without the block cache and on the JIT where there is one, and prints how fast they went as JSON.
+int main(int argc, char **argv) {
+    if (argc > 2 || (argc == 2 && (seconds = atof(argv[1])) <= 0)) {
+        fputs("Usage: chip8-bench [seconds_per_case]\n", stderr);
+        return 1;
+    }
+
+    struct Chip8Cache *cache = chip8_cache_new();
+    struct Chip8Jit *jit = chip8_jit_new();
+    const size_t count = sizeof(bench_roms) / sizeof(bench_roms[0]);
+
+    printf("{\n  \"roms\": [\n");
+    // decoding every instruction as it runs, with the decoded blocks cached, and translated
+    for (size_t i = 0; i < count; i++) {
+        bench_rom(&bench_roms[i], "interpreter", NULL, NULL, false);
+    }
+    for (size_t i = 0; i < count; i++) {
+        bench_rom(&bench_roms[i], "cached", cache, NULL, !jit && i + 1 == count);
+    }
+    for (size_t i = 0; jit && i < count; i++) {
+        bench_rom(&bench_roms[i], "jit", cache, jit, i + 1 == count);
+    }
+    printf("  ],\n");
+    printf("  \"dxyn_ns\": %.2f,\n", bench_dxyn());
+    printf("  \"render_frame_ns\": %.2f\n", bench_render());
+    printf("}\n");
+
+    chip8_jit_free(jit);
+    chip8_cache_free(cache);
+    return 0;
+}
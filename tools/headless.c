@@ -0,0 +1,271 @@
+// needed for open
+#define _DEFAULT_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "cpu.h"
+#include "audio.h"
+#include "capture.h"
+#include "trace.h"
+#include "cache.h"
+#include "jit.h"
+#include "movie.h"
+#include "profile.h"
+
+// first line of a file of frame hashes, which is followed by the hash of the screen after every frame in hex
+#define HASHES_HEADER "chip8-frames 1"
+
+// reads a file of frame hashes, returns how many frames it has
+static long long load_hashes(const char *filename, uint64_t **hashes) {
+    FILE *file = fopen(filename, "r");
+    char header[sizeof(HASHES_HEADER) + 1];
+    if (!file || !fgets(header, sizeof(header), file) || strcmp(header, HASHES_HEADER "\n") != 0) {
+        fputs("Error: Could not read the golden frame hashes.", stderr);
+        exit(1);
+    }
+
+    long long count = 0;
+    long long size = 0;
+    *hashes = NULL;
+    unsigned long long hash;
+    while (fscanf(file, "%llx", &hash) == 1) {
+        if (count == size) {
+            size = size ? size * 2 : 4096;
+            *hashes = realloc(*hashes, size * sizeof(uint64_t));
+            if (!*hashes) {
+                fputs("Error: Could not allocate the golden frame hashes.", stderr);
+                exit(1);
+            }
+        }
+        (*hashes)[count++] = hash;
+    }
+    fclose(file);
+    return count;
+}
+
+static void usage(void) {
+    fputs("Usage: chip8-headless [-j] [-i instructions_per_frame] [-n instructions | -f frames] [-S seed] [-m movie] [-a audio] [-c | -C video] [-t hashes] [-g golden_hashes] [-T trace] <rom>\n", stderr);
+    exit(1);
+}
+
+// Runs a ROM with no display, as fast as the host allows, with no input or the input
+// of a movie, and prints the state it ends up in. The tone and the screen can be written to files,
+// the screen's hash after every frame written out or checked against the hashes of an earlier run,
+// and every instruction recorded.
+int main(int argc, char **argv) {
+    const char *rom = NULL;
+    bool use_jit = false;
+    int ipf = IPF;
+    long long instructions = -1;
+    long long frames = -1;
+    bool seeded = false;
+    uint64_t seed = 0;
+    const char *movie_file = NULL;
+    const char *audio_file = NULL;
+    const char *video_file = NULL;
+    bool changes_only = false;
+    const char *hashes_file = NULL;
+    const char *golden_file = NULL;
+    const char *trace_file = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0) {
+            use_jit = true;
+        } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            ipf = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            instructions = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            frames = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "-S") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 0);
+            seeded = true;
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            movie_file = argv[++i];
+        } else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+            audio_file = argv[++i];
+        } else if ((strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "-C") == 0) && i + 1 < argc) {
+            changes_only = argv[i][1] == 'C';
+            video_file = argv[++i];
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            hashes_file = argv[++i];
+        } else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+            golden_file = argv[++i];
+        } else if (strcmp(argv[i], "-T") == 0 && i + 1 < argc) {
+            trace_file = argv[++i];
+        } else if (argv[i][0] == '-') {
+            usage();
+        } else {
+            rom = argv[i];
+        }
+    }
+
+    if (!rom || ipf <= 0) {
+        usage();
+    }
+
+    // a movie brings its own seed and instructions per frame, and runs for as long as it was recorded
+    struct Chip8Movie movie = chip8_movie_new(seed, ipf);
+    if (movie_file) {
+        movie = chip8_movie_load(movie_file);
+        seed = movie.seed;
+        seeded = true;
+        ipf = movie.ipf;
+        if (frames < 0 && instructions < 0) {
+            frames = movie.frames;
+        }
+    }
+    // and so do golden hashes, which can't be checked past their end
+    uint64_t *golden = NULL;
+    long long golden_frames = 0;
+    if (golden_file) {
+        golden_frames = load_hashes(golden_file, &golden);
+        if (frames < 0 && instructions < 0) {
+            frames = golden_frames;
+        }
+    }
+    if (frames < 0) {
+        frames = FRAMERATE * 60;
+    }
+
+    // the frames needed to run that many instructions, the last one may be cut short
+    if (instructions >= 0) {
+        frames = (instructions + ipf - 1) / ipf;
+    } else {
+        instructions = frames * ipf;
+    }
+    if (golden && frames > golden_frames) {
+        fprintf(stderr, "Error: The golden hashes only go up to frame %lld.", golden_frames);
+        return 1;
+    }
+
+    struct Chip8 chip8 = chip8_new();
+    chip8_load_rom(&chip8, rom);
+    if (seeded) {
+        chip8_seed(&chip8, seed);
+    }
+    chip8.cache = chip8_cache_new();
+#ifdef CHIP8_PROFILER
+    chip8.profile = chip8_profile_new();
+#endif
+    if (use_jit) {
+        chip8.jit = chip8_jit_new();
+    }
+    if (trace_file) {
+        chip8.trace = chip8_trace_new(trace_file);
+    }
+
+    struct Chip8AudioFile audio;
+    if (audio_file) {
+        chip8_audio_file_open(&audio, audio_file, AUDIO_RATE);
+    }
+
+    // the video can go to stdout, the state is printed to stderr then
+    FILE *report = stdout;
+    struct Chip8Capture *capture = NULL;
+    if (video_file) {
+        const size_t len = strlen(video_file);
+        const enum Chip8CaptureFormat format = len >= 4 && strcmp(video_file + len - 4, ".y4m") == 0 ? CAPTURE_Y4M : CAPTURE_RAW;
+        int fd = STDOUT_FILENO;
+        if (strcmp(video_file, "-") == 0) {
+            report = stderr;
+        } else if ((fd = open(video_file, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+            fputs("Error: Could not create the video file.", stderr);
+            return 1;
+        }
+        capture = chip8_capture_new(fd, format, changes_only);
+    }
+
+    FILE *hashes = NULL;
+    if (hashes_file) {
+        hashes = fopen(hashes_file, "w");
+        if (!hashes) {
+            fputs("Error: Could not create the frame hashes file.", stderr);
+            return 1;
+        }
+        fputs(HASHES_HEADER "\n", hashes);
+    }
+
+    struct timespec start, end;
+    timespec_get(&start, TIME_UTC);
+
+    long long done = 0;
+    // the first frame whose screen isn't the golden one, and the frames that were compared
+    long long diverged = -1;
+    long long checked = 0;
+    for (long long frame = 0; frame < frames; frame++) {
+        chip8_movie_play(&movie, frame, &chip8);
+        if (instructions - done < ipf) {
+            done += chip8_run(&chip8, instructions - done);
+            break;
+        }
+        done += chip8_run_frame(&chip8, ipf);
+        if (audio_file) {
+            chip8_audio_file_frame(&audio, &chip8);
+        }
+        if (capture) {
+            chip8_capture_frame(capture, &chip8);
+        }
+        if (hashes) {
+            fprintf(hashes, "%016llx\n", (unsigned long long)chip8.video_hash);
+        }
+        if (golden && chip8.video_hash != golden[frame]) {
+            diverged = frame;
+            frames = frame + 1;
+            break;
+        }
+        checked++;
+    }
+    // the trace is only complete once the writer is done with it, which is part of the time taken
+    chip8_trace_free(chip8.trace);
+
+    timespec_get(&end, TIME_UTC);
+    const double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    fprintf(report, "instructions: %lld\n", done);
+    fprintf(report, "frames: %lld\n", frames);
+    fprintf(report, "pc: 0x%03X\n", chip8.pc);
+    fprintf(report, "I: 0x%03X\n", chip8.index);
+    fprintf(report, "registers:");
+    for (int i = V0; i <= VF; i++) {
+        fprintf(report, " %02X", chip8.registers[i]);
+    }
+    fprintf(report, "\n");
+    fprintf(report, "seconds: %.3f\n", seconds);
+    fprintf(report, "MIPS: %.1f\n", seconds > 0 ? done / seconds / 1e6 : 0.0);
+
+    if (golden) {
+        if (diverged >= 0) {
+            fprintf(report, "golden: the screen differs after frame %lld\n", diverged);
+        } else {
+            fprintf(report, "golden: %lld frames match\n", checked);
+        }
+    }
+
+    if (audio_file) {
+        chip8_audio_file_close(&audio);
+    }
+    if (hashes && fclose(hashes) != 0) {
+        fputs("Error: Could not write the frame hashes file.", stderr);
+        return 1;
+    }
+    free(golden);
+    if (capture) {
+        const int fd = capture->fd;
+        chip8_capture_free(capture);
+        if (fd != STDOUT_FILENO) {
+            close(fd);
+        }
+    }
+    chip8_movie_free(&movie);
+#ifdef CHIP8_PROFILER
+    chip8_profile_report(chip8.profile, &chip8, CHIP8_PROFILE_TOP, stderr);
+    chip8_profile_free(chip8.profile);
+#endif
+    chip8_jit_free(chip8.jit);
+    chip8_cache_free(chip8.cache);
+    return diverged >= 0;
+}
@@ -0,0 +1,46 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "cpu.h"
+#include "cache.h"
+#include "jit.h"
+#include "state.h"
+
+// Runs a ROM through the JIT and through the interpreter side by side,
+// comparing their whole state after every block (or run of blocks native code went through).
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fputs("Usage: chip8-jitcheck <rom> [instructions]\n", stderr);
+        return 1;
+    }
+    const long total = argc > 2 ? atol(argv[2]) : 10000000;
+
+    struct Chip8 interp = chip8_new();
+    chip8_load_rom(&interp, argv[1]);
+
+    struct Chip8 native = interp;
+    native.cache = chip8_cache_new();
+    native.jit = chip8_jit_new();
+    if (!native.jit) {
+        fputs("Error: The JIT isn't supported on this host.", stderr);
+        return 1;
+    }
+
+    long done = 0;
+    while (done < total) {
+        const uint16_t pc = native.pc;
+        const int n = chip8_run_block(&native, total - done);
+        chip8_run(&interp, n);
+        done += n;
+
+        const char *diff = chip8_state_diff(&interp, &native);
+        if (diff) {
+            printf("Mismatch in %s after the block at 0x%03X, %ld instructions in.\n", diff, pc, done);
+            return 1;
+        }
+    }
+
+    printf("OK: %ld instructions matched.\n", done);
+    chip8_jit_free(native.jit);
+    chip8_cache_free(native.cache);
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "cpu.h"
+#include "lanes.h"
+#include "state.h"
+
+static double chip8_seconds(void) {
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Runs copies of a ROM in lockstep on the lanes and one by one on the interpreter,
+// each copy with its own seed and key held down so that they go their own ways,
+// and compares every copy after every frame.
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fputs("Usage: chip8-lanecheck <rom> [lanes] [frames]\n", stderr);
+        return 1;
+    }
+    const int count = argc > 2 ? atoi(argv[2]) : 256;
+    const long frames = argc > 3 ? atol(argv[3]) : 600;
+    if (count <= 0) {
+        fputs("Error: There has to be at least one lane.", stderr);
+        return 1;
+    }
+
+    struct Chip8Lanes *lanes = chip8_lanes_new(count);
+    chip8_lanes_load_rom(lanes, argv[1]);
+    struct Chip8 *interp = malloc(count * sizeof(struct Chip8));
+    if (!interp) {
+        fputs("Error: Could not allocate the machines.", stderr);
+        return 1;
+    }
+    for (int i = 0; i < count; i++) {
+        struct Chip8 *chip8 = chip8_lanes_get(lanes, i);
+        chip8->rng = RNG_SEED + i * 0x9E3779B9;
+        if (!chip8->rng) {
+            chip8->rng = RNG_SEED;
+        }
+        chip8->keypad[i % KEYPADSIZ] = 1;
+        chip8_lanes_set(lanes, i, chip8);
+        interp[i] = *chip8;
+    }
+
+    double in_lanes = 0;
+    double one_by_one = 0;
+    for (long frame = 0; frame < frames; frame++) {
+        double start = chip8_seconds();
+        chip8_lanes_run_frame(lanes, IPF);
+        in_lanes += chip8_seconds() - start;
+
+        start = chip8_seconds();
+        for (int i = 0; i < count; i++) {
+            chip8_run_frame(&interp[i], IPF);
+        }
+        one_by_one += chip8_seconds() - start;
+
+        for (int i = 0; i < count; i++) {
+            const char *diff = chip8_state_diff(&interp[i], chip8_lanes_get(lanes, i));
+            if (diff) {
+                printf("Mismatch in %s of lane %d after frame %ld.\n", diff, i, frame);
+                return 1;
+            }
+        }
+    }
+
+    printf("OK: %d lanes matched for %ld frames, %.1fx as fast as one by one.\n",
+           count, frames, in_lanes > 0 ? one_by_one / in_lanes : 0.0);
+    free(interp);
+    chip8_lanes_free(lanes);
+    return 0;
+}
@@ -0,0 +1,47 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "cpu.h"
+#include "disasm.h"
+#include "trace.h"
+
+// Prints the instructions of an execution trace, one per line: their number, address,
+// opcode and assembly, then what they changed. Starts at instruction `first` if given
+// and prints `count` of them, all of the rest if not.
+int main(int argc, char **argv) {
+    if (argc < 2 || argc > 4) {
+        fputs("Usage: chip8-tracedump <trace> [first] [count]\n", stderr);
+        return 1;
+    }
+    const long long first = argc > 2 ? atoll(argv[2]) : 0;
+    const long long count = argc > 3 ? atoll(argv[3]) : -1;
+
+    struct Chip8TraceReader *reader = chip8_trace_open(argv[1]);
+    struct Chip8TraceRecord record;
+    for (long long n = 0; (count < 0 || n < first + count) && chip8_trace_read(reader, &record); n++) {
+        if (n < first) {
+            continue;
+        }
+
+        char text[32];
+        chip8_disassemble(record.opcode, text, sizeof(text));
+        printf("%lld %03X %04X %-16s", n, record.pc, record.opcode, text);
+        for (int r = V0; r <= VF; r++) {
+            if (record.written & 1u << r) {
+                printf(" V%X=%02X", r, record.registers[r]);
+            }
+        }
+        if (record.flags & CHIP8_TRACE_INDEX) {
+            printf(" I=%03X", record.index);
+        }
+        if (record.flags & CHIP8_TRACE_DT) {
+            printf(" DT=%02X", record.delay_timer);
+        }
+        if (record.flags & CHIP8_TRACE_ST) {
+            printf(" ST=%02X", record.sound_timer);
+        }
+        printf("\n");
+    }
+
+    chip8_trace_close(reader);
+    return 0;
+}